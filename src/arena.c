@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "parallel.h"
+#include "numa_place.h"
+
+/*
+ * Implementation of the scratch arena.
+ * Every block starts with a header that records the slice it was carved from (NULL for heap
+ * blocks), so that it can be released by any worker: a task may allocate on one worker and
+ * free on another once its continuation has been stolen. The slices are only locked for the
+ * few instructions that move their top.
+ */
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct Scratch_Slice {
+	char *base;
+	size_t size;
+	size_t top;           // Offset of the first free byte
+	size_t last;          // Offset of the last block, when top > 0
+	int lock;
+	int touched;          // 1 once the pages of the slice have been faulted in
+} __attribute__((aligned(ARENA_ALIGNMENT))) Scratch_Slice;
+
+typedef struct Scratch_Block {
+	Scratch_Slice *slice;  // NULL if the block comes from the heap
+	Scratch_Arena *arena;  // Arena that accounts for the block, may be NULL
+	size_t size;           // # bytes of the block, header included
+	size_t prev;           // Offset of the previous block of the slice
+	int freed;
+} Scratch_Block;
+
+// The header keeps the blocks aligned
+#define HEADER_SIZE ARENA_ALIGNMENT
+
+_Static_assert (sizeof(Scratch_Block) <= HEADER_SIZE, "block header larger than its alignment");
+
+struct Scratch_Arena {
+	void *memory;
+	size_t mapped;        // # bytes mapped at memory
+	Scratch_Slice *slices;
+	size_t nSlices;
+
+	size_t inUse;         // # bytes allocated, heap fallbacks included
+	size_t highWater;
+	size_t overflows;
+};
+
+static Scratch_Arena *current = NULL;
+
+static void lockSlice(Scratch_Slice *slice) {
+	while (__atomic_exchange_n(&slice->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&slice->lock, __ATOMIC_RELAXED))
+			;
+}
+
+static void unlockSlice(Scratch_Slice *slice) {
+	__atomic_store_n(&slice->lock, 0, __ATOMIC_RELEASE);
+}
+
+static void touchSlice(Scratch_Slice *slice) {
+	memset(slice->base, 0, slice->size);
+	slice->touched = 1;
+}
+
+static void touchOwnSlice(void *arg) {
+	Scratch_Arena *arena = arg;
+	int id = par_worker_id();
+	if (id >= 0 && id < arena->nSlices && !arena->slices[id].touched)
+		touchSlice(&arena->slices[id]);
+}
+
+static void touchSlices(size_t start, size_t end, void *arg) {
+	Scratch_Arena *arena = arg;
+	for (size_t i = start; i < end; i++)
+		if (!arena->slices[i].touched)
+			touchSlice(&arena->slices[i]);
+}
+
+Scratch_Arena *arena_create (size_t capacity, int flags) {
+	Scratch_Arena *arena = calloc(1, sizeof(Scratch_Arena));
+	assert (arena != NULL);
+
+	arena->nSlices = par_total_workers();
+	size_t sliceSize = (capacity / arena->nSlices) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+
+	arena->mapped = arena->nSlices * sliceSize;
+	if (flags & ARENA_HUGE_PAGES)
+		arena->mapped = (arena->mapped + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	if (arena->mapped > 0) {
+		void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if (flags & ARENA_HUGE_PAGES)
+			memory = mmap(NULL, arena->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		// Without reserved huge pages, ask for transparent ones
+		if (memory == MAP_FAILED) {
+			memory = mmap(NULL, arena->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED) {
+				free(arena);
+				return NULL;
+			}
+#ifdef MADV_HUGEPAGE
+			if (flags & ARENA_HUGE_PAGES)
+				madvise(memory, arena->mapped, MADV_HUGEPAGE);
+#endif
+		}
+		arena->memory = memory;
+	}
+
+	arena->slices = aligned_alloc(ARENA_ALIGNMENT, arena->nSlices * sizeof(Scratch_Slice));
+	assert (arena->slices != NULL);
+	for (size_t i = 0; i < arena->nSlices; i++)
+		arena->slices[i] = (Scratch_Slice) { (char *)arena->memory + i * sliceSize, sliceSize, 0, 0, 0, 0 };
+
+	// Fault the pages in now rather than in the first calls. Each worker touches its own slice
+	// first, so that it lands on the worker's node, then the slices of the workers that did not
+	// take part are touched by any worker.
+	numa_each_worker(touchOwnSlice, arena);
+	par_for(0, arena->nSlices, 1, touchSlices, arena);
+
+	return arena;
+}
+
+void arena_destroy (Scratch_Arena *arena) {
+	assert (arena != NULL);
+	// Outstanding blocks would be freed into the unmapped slices
+	assert (__atomic_load_n(&arena->inUse, __ATOMIC_RELAXED) == 0);
+
+	if (current == arena)
+		current = NULL;
+
+	if (arena->memory != NULL)
+		munmap(arena->memory, arena->mapped);
+	free(arena->slices);
+	free(arena);
+}
+
+void arena_set_current (Scratch_Arena *arena) {
+	current = arena;
+}
+
+Scratch_Arena *arena_current (void) {
+	return current;
+}
+
+size_t arena_high_water (Scratch_Arena *arena) {
+	assert (arena != NULL);
+
+	return __atomic_load_n(&arena->highWater, __ATOMIC_RELAXED);
+}
+
+size_t arena_overflows (Scratch_Arena *arena) {
+	assert (arena != NULL);
+
+	return __atomic_load_n(&arena->overflows, __ATOMIC_RELAXED);
+}
+
+void arena_reset_stats (Scratch_Arena *arena) {
+	assert (arena != NULL);
+
+	__atomic_store_n(&arena->highWater, __atomic_load_n(&arena->inUse, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_store_n(&arena->overflows, 0, __ATOMIC_RELAXED);
+}
+
+static void account(Scratch_Arena *arena, size_t size) {
+	size_t inUse = __atomic_add_fetch(&arena->inUse, size, __ATOMIC_RELAXED);
+	size_t highWater = __atomic_load_n(&arena->highWater, __ATOMIC_RELAXED);
+
+	while (inUse > highWater && !__atomic_compare_exchange_n(&arena->highWater, &highWater, inUse, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void *scratch_alloc (size_t size) {
+	Scratch_Arena *arena = current;
+	size_t blockSize = HEADER_SIZE + (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	Scratch_Block *block;
+
+	if (arena != NULL) {
+		account(arena, blockSize);
+
+		int id = par_worker_id();
+		if (id >= 0 && id < arena->nSlices) {
+			Scratch_Slice *slice = &arena->slices[id];
+
+			lockSlice(slice);
+			if (slice->size - slice->top >= blockSize) {
+				block = (Scratch_Block *)(slice->base + slice->top);
+				*block = (Scratch_Block) { slice, arena, blockSize, slice->last, 0 };
+				slice->last = slice->top;
+				slice->top += blockSize;
+				unlockSlice(slice);
+
+				return (char *)block + HEADER_SIZE;
+			}
+			unlockSlice(slice);
+		}
+
+		__atomic_add_fetch(&arena->overflows, 1, __ATOMIC_RELAXED);
+	}
+
+	block = aligned_alloc(ARENA_ALIGNMENT, blockSize);
+	assert (block != NULL);
+	*block = (Scratch_Block) { NULL, arena, blockSize, 0, 0 };
+
+	return (char *)block + HEADER_SIZE;
+}
+
+void scratch_free (void *ptr) {
+	if (ptr == NULL)
+		return;
+
+	Scratch_Block *block = (Scratch_Block *)((char *)ptr - HEADER_SIZE);
+
+	if (block->arena != NULL)
+		__atomic_sub_fetch(&block->arena->inUse, block->size, __ATOMIC_RELAXED);
+
+	Scratch_Slice *slice = block->slice;
+	if (slice == NULL) {
+		free(block);
+		return;
+	}
+
+	lockSlice(slice);
+	block->freed = 1;
+
+	// Release the free blocks at the top of the stack
+	while (slice->top > 0) {
+		Scratch_Block *last = (Scratch_Block *)(slice->base + slice->last);
+		if (!last->freed)
+			break;
+		slice->top = slice->last;
+		slice->last = last->prev;
+	}
+	unlockSlice(slice);
+}
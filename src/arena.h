@@ -0,0 +1,69 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Scratch arena for the temporaries of the patterns (bit sums, ping-pong buffers, scan trees, ...).
+ * The application creates it once and makes it current, and from then on the patterns carve
+ * their temporaries out of it instead of calling malloc and free on every call.
+ *
+ * The memory is mapped when the arena is created, and split into one slice per worker, so that
+ * workers allocating at the same time do not contend. Each worker faults its slice in itself, so
+ * that the slice is placed on the worker's NUMA node; the arena must therefore be created outside
+ * of any parallel work. Each slice is used as a stack: a block is released when it and every
+ * block allocated after it in the slice are free. Requests that do not fit in the slice of the
+ * calling worker, or made while no arena is current, fall back to the heap.
+ */
+
+typedef struct Scratch_Arena Scratch_Arena;
+
+// Flags of arena_create
+#define ARENA_HUGE_PAGES 1    // Back the arena with huge pages (transparent huge pages if none are reserved)
+
+// Alignment of the blocks returned by scratch_alloc
+#define ARENA_ALIGNMENT 64
+
+Scratch_Arena *arena_create (
+  size_t capacity,      // # bytes of the arena, shared by all the slices
+  int flags             // ARENA_* flags
+);
+
+/*
+ * Destroys the arena, which must have no block outstanding.
+ */
+void arena_destroy (Scratch_Arena *arena);
+
+/*
+ * Makes the arena used by the patterns, or NULL to use the heap. Must not be changed while
+ * patterns are running: every pattern that may use the arena, including the ones queued with
+ * the async_* calls and the jobs of a running persistent farm, must have finished before it is
+ * replaced with arena_set_current(NULL) and destroyed with arena_destroy.
+ */
+void arena_set_current (Scratch_Arena *arena);
+
+Scratch_Arena *arena_current (void);
+
+/*
+ * Largest # bytes allocated from the arena at the same time, since it was created or reset.
+ */
+size_t arena_high_water (Scratch_Arena *arena);
+
+/*
+ * # allocations that did not fit in their slice and went to the heap.
+ */
+size_t arena_overflows (Scratch_Arena *arena);
+
+void arena_reset_stats (Scratch_Arena *arena);
+
+/*
+ * Allocates size bytes from the current arena, aligned to ARENA_ALIGNMENT.
+ */
+void *scratch_alloc (size_t size);
+
+/*
+ * Releases a block of scratch_alloc, from any worker. Does nothing on NULL.
+ */
+void scratch_free (void *ptr);
+
+#endif
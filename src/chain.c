@@ -0,0 +1,414 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "chain.h"
+#include "parallel.h"
+#include "arena.h"
+
+/*
+ * Implementation of the lazy chains.
+ * A run goes over the tiles of the source in parallel. For each tile, the elements are read from
+ * the source (or gathered into a buffer), each map writes into the other buffer of a pair, and
+ * each pack copies the selected elements into the other buffer and records their source positions.
+ * The terminals that write an array first count, per tile, the positions that pass all the
+ * filters, which only needs the filters, to know where each tile writes its results.
+ */
+
+// Bytes of the intermediates of a tile, in each buffer
+#define CHAIN_TILE_BYTES (16 * 1024)
+
+typedef enum Stage_Type {
+	STAGE_MAP,
+	STAGE_PACK
+} Stage_Type;
+
+typedef struct Chain_Stage {
+	Stage_Type type;
+	void (*worker)(void *v1, const void *v2);  // map
+	size_t sizeOut;       // Size of the elements after the stage
+	const int *filter;    // pack
+} Chain_Stage;
+
+struct Chain {
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	const int *gather;    // Filter of a gathered source, or NULL
+	size_t nItems;        // # elements entering the stages
+
+	Chain_Stage *stages;
+	size_t nStages;
+	size_t capacity;
+
+	size_t sizeOut;       // Size of the elements after the last stage
+	size_t maxSize;       // Largest element size along the chain
+};
+
+typedef enum Chain_Terminal {
+	TERMINAL_REDUCE,
+	TERMINAL_SCAN,
+	TERMINAL_COLLECT
+} Chain_Terminal;
+
+typedef struct Chain_Run {
+	Chain *chain;
+	Chain_Terminal terminal;
+	size_t tileSize;      // # source elements of each tile
+	size_t nTiles;
+	void *dest;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+	size_t *offset;       // First position of the results of each tile (scan, collect)
+	void *partial;        // Reduction of each tile (reduce, scan)
+	size_t *nPartial;     // # elements of each tile in its partial, 0 if all were filtered out
+	void *carry;          // scan: reduction of the tiles before each tile
+	int *hasCarry;
+} Chain_Run;
+
+// Buffers of the tiles of one range of tiles
+typedef struct Tile_Buffers {
+	void *data[2];
+	size_t *position;     // Source position of each element, once a pack has run
+	void *tmp;            // One element of the output size
+} Tile_Buffers;
+
+static Chain *newChain(void *src, size_t nJob, size_t sizeJob, const int *gather, size_t nItems) {
+	Chain *chain = malloc(sizeof(Chain));
+	assert (chain != NULL);
+
+	*chain = (Chain) {
+		.src = src,
+		.nJob = nJob,
+		.sizeJob = sizeJob,
+		.gather = gather,
+		.nItems = nItems,
+		.sizeOut = sizeJob,
+		.maxSize = sizeJob
+	};
+
+	return chain;
+}
+
+Chain *chain_create (void *src, size_t nJob, size_t sizeJob) {
+	assert (src != NULL);
+
+	return newChain(src, nJob, sizeJob, NULL, nJob);
+}
+
+Chain *chain_gather (void *src, size_t nJob, size_t sizeJob, const int *filter, int nFilter) {
+	assert (src != NULL);
+	assert (filter != NULL);
+
+	return newChain(src, nJob, sizeJob, filter, nFilter);
+}
+
+static void addStage(Chain *chain, Chain_Stage stage) {
+	if (chain->nStages == chain->capacity) {
+		chain->capacity = chain->capacity == 0 ? 4 : 2 * chain->capacity;
+		chain->stages = realloc(chain->stages, chain->capacity * sizeof(Chain_Stage));
+		assert (chain->stages != NULL);
+	}
+
+	chain->stages[chain->nStages++] = stage;
+	chain->sizeOut = stage.sizeOut;
+	if (stage.sizeOut > chain->maxSize)
+		chain->maxSize = stage.sizeOut;
+}
+
+void chain_map (Chain *chain, void (*worker)(void *v1, const void *v2), size_t sizeOut) {
+	assert (chain != NULL);
+	assert (worker != NULL);
+
+	addStage(chain, (Chain_Stage) { STAGE_MAP, worker, sizeOut, NULL });
+}
+
+void chain_pack (Chain *chain, const int *filter) {
+	assert (chain != NULL);
+	assert (filter != NULL);
+
+	addStage(chain, (Chain_Stage) { STAGE_PACK, NULL, chain->sizeOut, filter });
+}
+
+void chain_destroy (Chain *chain) {
+	assert (chain != NULL);
+
+	free(chain->stages);
+	free(chain);
+}
+
+static size_t tileEnd(Chain_Run *run, size_t tile) {
+	size_t end = (tile + 1) * run->tileSize;
+	return end < run->chain->nItems ? end : run->chain->nItems;
+}
+
+/*
+ * Runs the stages over a tile. Returns the elements left after the last stage, which are in the
+ * source array or in one of the buffers, and their # in count.
+ */
+static const void *runTile(Chain_Run *run, size_t tile, Tile_Buffers *buffers, size_t *count) {
+	Chain *chain = run->chain;
+	size_t first = tile * run->tileSize;
+	size_t n = tileEnd(run, tile) - first;
+	size_t size = chain->sizeJob;
+
+	const void *in;
+	const size_t *position = NULL;  // NULL while the elements are still in source order
+	int next = 0;                   // Buffer written by the next stage
+
+	if (chain->gather != NULL) {
+		for (size_t k = 0; k < n; k++)
+			memcpy(buffers->data[0] + k * size, chain->src + (size_t)chain->gather[first + k] * size, size);
+		in = buffers->data[0];
+		next = 1;
+	} else {
+		in = chain->src + first * size;
+	}
+
+	for (size_t s = 0; s < chain->nStages; s++) {
+		Chain_Stage *stage = &chain->stages[s];
+		void *out = buffers->data[next];
+
+		if (stage->type == STAGE_MAP) {
+			for (size_t k = 0; k < n; k++)
+				stage->worker(out + k * stage->sizeOut, in + k * size);
+		} else {
+			// m <= k, so the positions can be compacted in place
+			size_t *outPosition = buffers->position;
+			size_t m = 0;
+			for (size_t k = 0; k < n; k++) {
+				size_t source = position == NULL ? first + k : position[k];
+				if (stage->filter[source]) {
+					memcpy(out + m * size, in + k * size, size);
+					outPosition[m++] = source;
+				}
+			}
+			n = m;
+			position = outPosition;
+		}
+
+		in = out;
+		size = stage->sizeOut;
+		next = 1 - next;
+	}
+
+	*count = n;
+	return in;
+}
+
+// # elements of the tiles that pass all the filters
+static void countRange(size_t start, size_t end, void *arg) {
+	Chain_Run *run = arg;
+	Chain *chain = run->chain;
+
+	for (size_t tile = start; tile < end; tile++) {
+		size_t count = 0;
+		for (size_t i = tile * run->tileSize; i < tileEnd(run, tile); i++) {
+			int selected = 1;
+			for (size_t s = 0; s < chain->nStages && selected; s++)
+				if (chain->stages[s].type == STAGE_PACK)
+					selected = chain->stages[s].filter[i] != 0;
+			count += selected;
+		}
+		run->offset[tile] = count;
+	}
+}
+
+// Reduces count elements into dest, using tmp as a second accumulator
+static void reduceElements(void *dest, const void *in, size_t count, size_t size, void *tmp, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	memcpy(dest, in, size);
+	for (size_t k = 1; k < count; k++) {
+		worker(tmp, dest, in + k * size);
+		memcpy(dest, tmp, size);
+	}
+}
+
+static void tileRange(size_t start, size_t end, void *arg) {
+	Chain_Run *run = arg;
+	Chain *chain = run->chain;
+	size_t size = chain->sizeOut;
+
+	Tile_Buffers buffers;
+	buffers.data[0] = scratch_alloc(run->tileSize * chain->maxSize);
+	buffers.data[1] = scratch_alloc(run->tileSize * chain->maxSize);
+	buffers.position = scratch_alloc(run->tileSize * sizeof(size_t));
+	buffers.tmp = scratch_alloc(size);
+
+	for (size_t tile = start; tile < end; tile++) {
+		size_t count;
+		const void *in = runTile(run, tile, &buffers, &count);
+
+		if (run->terminal == TERMINAL_COLLECT) {
+			memcpy(run->dest + run->offset[tile] * size, in, count * size);
+			continue;
+		}
+
+		run->nPartial[tile] = count;
+		if (count == 0)
+			continue;
+
+		if (run->terminal == TERMINAL_REDUCE) {
+			reduceElements(run->partial + tile * size, in, count, size, buffers.tmp, run->worker);
+		} else {
+			// Local scan of the tile, fixed up with the carry of the previous tiles afterwards
+			void *out = run->dest + run->offset[tile] * size;
+			memcpy(out, in, size);
+			for (size_t k = 1; k < count; k++)
+				run->worker(out + k * size, out + (k-1) * size, in + k * size);
+			memcpy(run->partial + tile * size, out + (count-1) * size, size);
+		}
+	}
+
+	scratch_free(buffers.tmp);
+	scratch_free(buffers.position);
+	scratch_free(buffers.data[1]);
+	scratch_free(buffers.data[0]);
+}
+
+static void carryRange(size_t start, size_t end, void *arg) {
+	Chain_Run *run = arg;
+	size_t size = run->chain->sizeOut;
+	void *tmp = scratch_alloc(size);
+
+	for (size_t tile = start; tile < end; tile++) {
+		if (!run->hasCarry[tile])
+			continue;
+
+		void *carry = run->carry + tile * size;
+		void *out = run->dest + run->offset[tile] * size;
+		size_t count = run->offset[tile+1] - run->offset[tile];
+		for (size_t k = 0; k < count; k++) {
+			run->worker(tmp, carry, out + k * size);
+			memcpy(out + k * size, tmp, size);
+		}
+	}
+
+	scratch_free(tmp);
+}
+
+static void initRun(Chain_Run *run, Chain *chain, Chain_Terminal terminal, void *dest, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	size_t tileSize = CHAIN_TILE_BYTES / chain->maxSize;
+
+	*run = (Chain_Run) {
+		.chain = chain,
+		.terminal = terminal,
+		.tileSize = tileSize > 0 ? tileSize : 1,
+		.dest = dest,
+		.worker = worker
+	};
+	run->nTiles = (chain->nItems + run->tileSize - 1) / run->tileSize;
+}
+
+// Computes the first position of each tile, and the total in offset[nTiles]
+static size_t computeOffsets(Chain_Run *run) {
+	run->offset = scratch_alloc((run->nTiles + 1) * sizeof(size_t));
+	par_for(0, run->nTiles, 1, countRange, run);
+
+	size_t total = 0;
+	for (size_t tile = 0; tile < run->nTiles; tile++) {
+		size_t count = run->offset[tile];
+		run->offset[tile] = total;
+		total += count;
+	}
+	run->offset[run->nTiles] = total;
+
+	return total;
+}
+
+size_t chain_reduce (Chain *chain, void *dest, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (chain != NULL);
+	assert (dest != NULL);
+	assert (worker != NULL);
+
+	Chain_Run run;
+	initRun(&run, chain, TERMINAL_REDUCE, dest, worker);
+	size_t size = chain->sizeOut;
+
+	run.partial = scratch_alloc(run.nTiles * size);
+	run.nPartial = scratch_alloc(run.nTiles * sizeof(size_t));
+	par_for(0, run.nTiles, 1, tileRange, &run);
+
+	// Combine the tiles that kept some elements
+	void *tmp = scratch_alloc(size);
+	size_t reduced = 0;
+	for (size_t tile = 0; tile < run.nTiles; tile++) {
+		if (run.nPartial[tile] == 0)
+			continue;
+		if (reduced == 0) {
+			memcpy(dest, run.partial + tile * size, size);
+		} else {
+			worker(tmp, dest, run.partial + tile * size);
+			memcpy(dest, tmp, size);
+		}
+		reduced += run.nPartial[tile];
+	}
+
+	scratch_free(tmp);
+	scratch_free(run.nPartial);
+	scratch_free(run.partial);
+
+	return reduced;
+}
+
+size_t chain_scan (Chain *chain, void *dest, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (chain != NULL);
+	assert (dest != NULL);
+	assert (worker != NULL);
+
+	Chain_Run run;
+	initRun(&run, chain, TERMINAL_SCAN, dest, worker);
+	size_t size = chain->sizeOut;
+
+	size_t total = computeOffsets(&run);
+
+	run.partial = scratch_alloc(run.nTiles * size);
+	run.nPartial = scratch_alloc(run.nTiles * sizeof(size_t));
+	par_for(0, run.nTiles, 1, tileRange, &run);
+
+	// Carry of each tile: the reduction of all the tiles before it
+	run.carry = scratch_alloc(run.nTiles * size);
+	run.hasCarry = scratch_alloc(run.nTiles * sizeof(int));
+	void *running = scratch_alloc(size);
+	void *tmp = scratch_alloc(size);
+	int found = 0;
+	for (size_t tile = 0; tile < run.nTiles; tile++) {
+		run.hasCarry[tile] = found && run.nPartial[tile];
+		if (run.hasCarry[tile])
+			memcpy(run.carry + tile * size, running, size);
+
+		if (!run.nPartial[tile])
+			continue;
+		if (!found) {
+			memcpy(running, run.partial + tile * size, size);
+			found = 1;
+		} else {
+			worker(tmp, running, run.partial + tile * size);
+			memcpy(running, tmp, size);
+		}
+	}
+	scratch_free(tmp);
+	scratch_free(running);
+
+	par_for(0, run.nTiles, 1, carryRange, &run);
+
+	scratch_free(run.hasCarry);
+	scratch_free(run.carry);
+	scratch_free(run.nPartial);
+	scratch_free(run.partial);
+	scratch_free(run.offset);
+
+	return total;
+}
+
+size_t chain_collect (Chain *chain, void *dest) {
+	assert (chain != NULL);
+	assert (dest != NULL);
+
+	Chain_Run run;
+	initRun(&run, chain, TERMINAL_COLLECT, dest, NULL);
+
+	size_t total = computeOffsets(&run);
+	par_for(0, run.nTiles, 1, tileRange, &run);
+
+	scratch_free(run.offset);
+
+	return total;
+}
@@ -0,0 +1,80 @@
+#ifndef __CHAIN_H
+#define __CHAIN_H
+
+#include <stddef.h>
+
+/*
+ * Lazy chains of patterns. A chain starts from a source array (or a gather of one), stacks
+ * elementwise stages (map, pack) and runs when a terminal (reduce, scan, collect) is applied:
+ *
+ *   Chain *chain = chain_create (src, nJob, sizeof(double));
+ *   chain_map (chain, workerAddOne, sizeof(double));
+ *   chain_pack (chain, filter);
+ *   chain_reduce (chain, &sum, workerAdd);
+ *   chain_destroy (chain);
+ *
+ * The chain is executed in tiles of a few KB: each worker loads a tile of the source, runs all
+ * the stages on it and feeds the result to the terminal, so the intermediates of the stages
+ * never leave the cache and there is no full pass, nor temporary array, per stage.
+ *
+ * The filters of pack are indexed by the position in the source of the chain (the position in
+ * the filter of the gather for a gathered source), not by the position after the previous
+ * packs, so that the position of each result can be computed from the filters alone.
+ */
+
+typedef struct Chain Chain;
+
+Chain *chain_create (
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob        // Size of each element in the source array
+);
+
+/*
+ * Chain whose element i is src[filter[i]].
+ */
+Chain *chain_gather (
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  const int *filter,    // Filter for gather
+  int nFilter           // # elements in the filter
+);
+
+void chain_map (
+  Chain *chain,
+  void (*worker)(void *v1, const void *v2), // [ v1 = op (v2) ]
+  size_t sizeOut        // Size of each element after the map
+);
+
+void chain_pack (
+  Chain *chain,
+  const int *filter     // Filter for pack, indexed by source position
+);
+
+/*
+ * Terminals: run the chain. A chain can be run several times, and is released by chain_destroy.
+ */
+// Returns the # elements reduced; dest is left untouched if it is 0 (all of them were filtered out)
+size_t chain_reduce (
+  Chain *chain,
+  void *dest,           // Target element
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+// Returns the # elements written to dest
+size_t chain_scan (
+  Chain *chain,
+  void *dest,           // Target array
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+// Returns the # elements written to dest
+size_t chain_collect (
+  Chain *chain,
+  void *dest            // Target array
+);
+
+void chain_destroy (Chain *chain);
+
+#endif
@@ -1,8 +1,8 @@
 #include <stdlib.h>
 #include <string.h>
-#include <cilk/cilk.h>
 #include <assert.h>
 #include "prefix_scan.h"
+#include "parallel.h"
 
 /*
  * Implementation of parallel Prefix-Scan algorithm using a dynamic binary tree.
@@ -22,10 +22,26 @@ typedef struct Binary_Node {
 	struct Binary_Node *right_child;
 } Binary_Node;
 
+/*
+ * Arguments of a pass over a subtree, so that the passes can be run as tasks.
+ */
+typedef struct Pass_Args {
+	Binary_Node *tree;
+	void *data;           // Input of the up pass, output of the down pass
+	size_t low;
+	size_t high;
+	size_t size_job;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+} Pass_Args;
+
 /*
  * Up pass of the prefix scan algorithm, which builds a binary tree given an input.
  */
-static void up_pass(Binary_Node *tree, void *input, size_t low, size_t high, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
+static void up_pass(void *arg) {
+	Pass_Args *args = arg;
+	Binary_Node *tree = args->tree;
+	void *input = args->data;
+	size_t low = args->low, high = args->high, size_job = args->size_job;
 	
 	tree->range_start = low;
 	tree->value = malloc(size_job);
@@ -41,18 +57,23 @@ static void up_pass(Binary_Node *tree, void *input, size_t low, size_t high, siz
 		tree->left_child = malloc(sizeof(Binary_Node));
 		tree->right_child = malloc(sizeof(Binary_Node));
 		
-		up_pass(tree->left_child, input, low, mid, size_job, worker);
-		cilk_spawn up_pass(tree->right_child, input, mid, high, size_job, worker);
+		Pass_Args left = { tree->left_child, input, low, mid, size_job, args->worker };
+		Pass_Args right = { tree->right_child, input, mid, high, size_job, args->worker };
+		par_invoke(up_pass, &left, up_pass, &right);
 		
-		cilk_sync;
-		worker(tree->value, tree->left_child->value, tree->right_child->value);
+		args->worker(tree->value, tree->left_child->value, tree->right_child->value);
 	}
 }
 
 /*
  * Down pass of the prefix scan algorithm, which fills a binary tree's from_left field, outputting the results of the leaves to an output.
  */
-static void down_pass(Binary_Node *tree, void *output, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
+static void down_pass(void *arg) {
+	Pass_Args *args = arg;
+	Binary_Node *tree = args->tree;
+	void *output = args->data;
+	size_t size_job = args->size_job;
+	void (*worker)(void *v1, const void *v2, const void *v3) = args->worker;
 	
 	if(tree->left_child == NULL && tree->right_child == NULL) {
 		worker(output + tree->range_start * size_job, tree->from_left, tree->value);
@@ -60,12 +81,11 @@ static void down_pass(Binary_Node *tree, void *output, size_t size_job, void (*w
 		memcpy(tree->left_child->from_left, tree->from_left, size_job);
 		worker(tree->right_child->from_left, tree->from_left, tree->left_child->value);
 		
-		down_pass(tree->left_child, output, size_job, worker);
-		cilk_spawn down_pass(tree->right_child, output, size_job, worker);
+		Pass_Args left = { tree->left_child, output, 0, 0, size_job, worker };
+		Pass_Args right = { tree->right_child, output, 0, 0, size_job, worker };
+		par_invoke(down_pass, &left, down_pass, &right);
 	}	
 	
-	cilk_sync;
-	
 	free(tree->value);
 	free(tree->from_left);
 	free(tree);
@@ -74,18 +94,20 @@ static void down_pass(Binary_Node *tree, void *output, size_t size_job, void (*w
 /*
  * Execute prefix scan algorithm.
  */
-void prefix_scan(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
+void prefix_scan_dynamic(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
 		
 	Binary_Node *tree = malloc(sizeof(Binary_Node));
 	
 	assert(tree != NULL);
 	
-	up_pass(tree, input, 0, n_jobs, size_job, worker);
+	Pass_Args up = { tree, input, 0, n_jobs, size_job, worker };
+	up_pass(&up);
 	
 	void *neutral_element = malloc(size_job);
 	worker(neutral_element, NULL, NULL);
 	memcpy(tree->from_left, neutral_element, size_job);
 	free(neutral_element);
 	
-	down_pass(tree, output, size_job, worker);
+	Pass_Args down = { tree, output, 0, 0, size_job, worker };
+	down_pass(&down);
 }
\ No newline at end of file
@@ -0,0 +1,434 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "patterns.h"
+#include "parallel.h"
+#include "arena.h"
+#include "file_patterns.h"
+
+/*
+ * Implementation of the out-of-core patterns.
+ * The inputs are read with pread into a chunk buffer. After each read, the kernel is asked to
+ * fetch the next chunk in the background and to drop the chunk just read, which is no longer
+ * needed once it has been copied into the buffer.
+ */
+
+static size_t chunk_bytes = FILE_CHUNK_BYTES;
+
+typedef struct File_Stream {
+	int fd;
+	size_t sizeJob;
+	size_t nJob;          // # elements in the file
+	size_t done;          // # elements read so far
+} File_Stream;
+
+void file_set_chunk_size (size_t bytes) {
+	chunk_bytes = bytes > 0 ? bytes : FILE_CHUNK_BYTES;
+}
+
+// # elements of each chunk
+static size_t chunkElements(size_t sizeJob) {
+	size_t n = chunk_bytes / sizeJob;
+	return n > 0 ? n : 1;
+}
+
+// Closes the files that are open (fd >= 0), keeping the errno of the failure that led here
+static void closeFiles(int fd1, int fd2) {
+	int error = errno;
+	if (fd1 >= 0)
+		close(fd1);
+	if (fd2 >= 0)
+		close(fd2);
+	errno = error;
+}
+
+static int openInput(File_Stream *stream, const char *path, size_t sizeJob) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		closeFiles(fd, -1);
+		return -1;
+	}
+	if (info.st_size % sizeJob != 0) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	*stream = (File_Stream) { fd, sizeJob, info.st_size / sizeJob, 0 };
+	return 0;
+}
+
+static int openOutput(const char *path) {
+	return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static int readFully(int fd, void *buffer, size_t bytes, off_t offset) {
+	while (bytes > 0) {
+		ssize_t n = pread(fd, buffer, bytes, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			// The file was truncated under us
+			if (n == 0)
+				errno = EIO;
+			return -1;
+		}
+		buffer += n;
+		bytes -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static int writeFully(int fd, const void *buffer, size_t bytes) {
+	while (bytes > 0) {
+		ssize_t n = write(fd, buffer, bytes);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		buffer += n;
+		bytes -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Reads the next chunk of at most nChunk elements. Returns the # elements read, 0 at the end of
+ * the file, or -1.
+ */
+static ssize_t readChunk(File_Stream *stream, void *buffer, size_t nChunk) {
+	size_t n = stream->nJob - stream->done;
+	if (n > nChunk)
+		n = nChunk;
+	if (n == 0)
+		return 0;
+
+	off_t offset = stream->done * stream->sizeJob;
+	size_t bytes = n * stream->sizeJob;
+	if (readFully(stream->fd, buffer, bytes, offset) != 0)
+		return -1;
+
+	posix_fadvise(stream->fd, offset + bytes, bytes, POSIX_FADV_WILLNEED);
+	posix_fadvise(stream->fd, offset, bytes, POSIX_FADV_DONTNEED);
+
+	stream->done += n;
+	return n;
+}
+
+int map_file (const char *destPath, const char *srcPath, size_t sizeJob, void (*worker)(void *v1, const void *v2)) {
+	assert (destPath != NULL);
+	assert (srcPath != NULL);
+	assert (worker != NULL);
+
+	File_Stream src;
+	if (openInput(&src, srcPath, sizeJob) != 0)
+		return -1;
+	int dest = openOutput(destPath);
+	if (dest < 0) {
+		closeFiles(src.fd, -1);
+		return -1;
+	}
+
+	size_t nChunk = chunkElements(sizeJob);
+	void *in = malloc(nChunk * sizeJob);
+	void *out = malloc(nChunk * sizeJob);
+	assert (in != NULL && out != NULL);
+
+	ssize_t n = 0;
+	int status = 0;
+	while (status == 0 && (n = readChunk(&src, in, nChunk)) > 0) {
+		map(out, in, n, sizeJob, worker);
+		status = writeFully(dest, out, n * sizeJob);
+	}
+	if (n < 0)
+		status = -1;
+
+	free(out);
+	free(in);
+
+	closeFiles(src.fd, dest);
+	return status;
+}
+
+int reduce_file (void *dest, const char *srcPath, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (dest != NULL);
+	assert (srcPath != NULL);
+	assert (worker != NULL);
+
+	File_Stream src;
+	if (openInput(&src, srcPath, sizeJob) != 0)
+		return -1;
+
+	size_t nChunk = chunkElements(sizeJob);
+	void *in = malloc(nChunk * sizeJob);
+	void *partial = malloc(sizeJob);
+	void *tmp = malloc(sizeJob);
+	assert (in != NULL && partial != NULL && tmp != NULL);
+
+	// The reductions of the chunks are combined in order
+	ssize_t n = 0;
+	int found = 0;
+	while ((n = readChunk(&src, in, nChunk)) > 0) {
+		reduce(partial, in, n, sizeJob, worker);
+		if (!found) {
+			memcpy(dest, partial, sizeJob);
+			found = 1;
+		} else {
+			worker(tmp, dest, partial);
+			memcpy(dest, tmp, sizeJob);
+		}
+	}
+
+	free(tmp);
+	free(partial);
+	free(in);
+
+	closeFiles(src.fd, -1);
+	return n < 0 ? -1 : 0;
+}
+
+typedef struct Carry_Args {
+	void *dest;
+	size_t sizeJob;
+	const void *carry;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+} Carry_Args;
+
+// dest[i] = carry + dest[i]
+static void carryRange(size_t start, size_t end, void *arg) {
+	Carry_Args *args = arg;
+	void *tmp = scratch_alloc(args->sizeJob);
+
+	for (size_t i = start; i < end; i++) {
+		args->worker(tmp, args->carry, args->dest + i * args->sizeJob);
+		memcpy(args->dest + i * args->sizeJob, tmp, args->sizeJob);
+	}
+
+	scratch_free(tmp);
+}
+
+int scan_file (const char *destPath, const char *srcPath, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (destPath != NULL);
+	assert (srcPath != NULL);
+	assert (worker != NULL);
+
+	File_Stream src;
+	if (openInput(&src, srcPath, sizeJob) != 0)
+		return -1;
+	int dest = openOutput(destPath);
+	if (dest < 0) {
+		closeFiles(src.fd, -1);
+		return -1;
+	}
+
+	size_t nChunk = chunkElements(sizeJob);
+	void *in = malloc(nChunk * sizeJob);
+	void *out = malloc(nChunk * sizeJob);
+	void *carry = malloc(sizeJob);
+	assert (in != NULL && out != NULL && carry != NULL);
+
+	ssize_t n = 0;
+	int status = 0;
+	int found = 0;
+	while (status == 0 && (n = readChunk(&src, in, nChunk)) > 0) {
+		scan(out, in, n, sizeJob, worker);
+
+		// Every chunk after the first starts from the last result of the previous one
+		if (found) {
+			Carry_Args args = { out, sizeJob, carry, worker };
+			par_for(0, n, 0, carryRange, &args);
+		}
+		memcpy(carry, out + (n - 1) * sizeJob, sizeJob);
+		found = 1;
+
+		status = writeFully(dest, out, n * sizeJob);
+	}
+	if (n < 0)
+		status = -1;
+
+	free(carry);
+	free(out);
+	free(in);
+
+	closeFiles(src.fd, dest);
+	return status;
+}
+
+ssize_t pack_file (const char *destPath, const char *srcPath, size_t sizeJob, const char *filterPath) {
+	assert (destPath != NULL);
+	assert (srcPath != NULL);
+	assert (filterPath != NULL);
+
+	File_Stream src, filter;
+	if (openInput(&src, srcPath, sizeJob) != 0)
+		return -1;
+	if (openInput(&filter, filterPath, sizeof(int)) != 0) {
+		closeFiles(src.fd, -1);
+		return -1;
+	}
+	if (filter.nJob != src.nJob) {
+		errno = EINVAL;
+		closeFiles(src.fd, filter.fd);
+		return -1;
+	}
+	int dest = openOutput(destPath);
+	if (dest < 0) {
+		closeFiles(src.fd, filter.fd);
+		return -1;
+	}
+
+	size_t nChunk = chunkElements(sizeJob);
+	void *in = malloc(nChunk * sizeJob);
+	void *out = malloc(nChunk * sizeJob);
+	int *selected = malloc(nChunk * sizeof(int));
+	assert (in != NULL && out != NULL && selected != NULL);
+
+	ssize_t n = 0;
+	ssize_t total = 0;
+	while (total >= 0 && (n = readChunk(&src, in, nChunk)) > 0) {
+		if (readChunk(&filter, selected, nChunk) != n) {
+			total = -1;
+			break;
+		}
+
+		int count = pack(out, in, n, sizeJob, selected);
+		total = writeFully(dest, out, count * sizeJob) == 0 ? total + count : -1;
+	}
+	if (n < 0)
+		total = -1;
+
+	free(selected);
+	free(out);
+	free(in);
+
+	closeFiles(filter.fd, -1);
+	closeFiles(src.fd, dest);
+	return total;
+}
+
+typedef struct Gather_Entry {
+	size_t index;         // Element of the source file
+	size_t position;      // Position of the element in the chunk of the output
+} Gather_Entry;
+
+typedef struct Gather_Args {
+	int fd;
+	size_t sizeJob;
+	const Gather_Entry *entries;  // Sorted by index
+	void *out;
+	int error;            // errno of the first read that failed, 0 if none did
+} Gather_Args;
+
+static int compareEntries(const void *a, const void *b) {
+	size_t x = ((const Gather_Entry *)a)->index, y = ((const Gather_Entry *)b)->index;
+	return x < y ? -1 : x > y;
+}
+
+// Reads the elements of the entries [start, end), with one pread for each span of nearby ones
+static void gatherRange(size_t start, size_t end, void *arg) {
+	Gather_Args *args = arg;
+	size_t sizeJob = args->sizeJob;
+	size_t spanJobs = GATHER_SPAN_BYTES / sizeJob > 0 ? GATHER_SPAN_BYTES / sizeJob : 1;
+	void *span = scratch_alloc(spanJobs * sizeJob);
+
+	size_t i = start;
+	while (i < end && __atomic_load_n(&args->error, __ATOMIC_RELAXED) == 0) {
+		size_t first = args->entries[i].index;
+		size_t last = i;
+		while (last + 1 < end && args->entries[last + 1].index < first + spanJobs)
+			last++;
+
+		size_t nSpan = args->entries[last].index - first + 1;
+		if (readFully(args->fd, span, nSpan * sizeJob, first * sizeJob) != 0) {
+			int error = errno;
+			__atomic_store_n(&args->error, error, __ATOMIC_RELAXED);
+			break;
+		}
+
+		for (; i <= last; i++)
+			memcpy(args->out + args->entries[i].position * sizeJob, span + (args->entries[i].index - first) * sizeJob, sizeJob);
+	}
+
+	scratch_free(span);
+}
+
+int gather_file (const char *destPath, const char *srcPath, size_t sizeJob, const char *filterPath) {
+	assert (destPath != NULL);
+	assert (srcPath != NULL);
+	assert (filterPath != NULL);
+
+	File_Stream src, filter;
+	if (openInput(&src, srcPath, sizeJob) != 0)
+		return -1;
+	if (openInput(&filter, filterPath, sizeof(int)) != 0) {
+		closeFiles(src.fd, -1);
+		return -1;
+	}
+
+	// The elements are read in the order of the indices, the kernel should not read ahead
+	posix_fadvise(src.fd, 0, 0, POSIX_FADV_RANDOM);
+
+	int dest = openOutput(destPath);
+	if (dest < 0) {
+		closeFiles(src.fd, filter.fd);
+		return -1;
+	}
+
+	size_t nChunk = chunkElements(sizeJob);
+	int *indices = malloc(nChunk * sizeof(int));
+	Gather_Entry *entries = malloc(nChunk * sizeof(Gather_Entry));
+	void *out = malloc(nChunk * sizeJob);
+	assert (indices != NULL && entries != NULL && out != NULL);
+
+	ssize_t n = 0;
+	int status = 0;
+	while (status == 0 && (n = readChunk(&filter, indices, nChunk)) > 0) {
+		for (ssize_t k = 0; k < n; k++) {
+			if (indices[k] < 0 || indices[k] >= src.nJob) {
+				errno = EINVAL;
+				status = -1;
+				break;
+			}
+			entries[k] = (Gather_Entry) { indices[k], k };
+		}
+		if (status != 0)
+			break;
+
+		// Sorted, the elements are read in the order of the file, and the nearby ones together
+		qsort(entries, n, sizeof(Gather_Entry), compareEntries);
+
+		Gather_Args args = { src.fd, sizeJob, entries, out, 0 };
+		par_for(0, n, 0, gatherRange, &args);
+		if (args.error != 0) {
+			errno = args.error;
+			status = -1;
+			break;
+		}
+
+		status = writeFully(dest, out, n * sizeJob);
+	}
+	if (n < 0)
+		status = -1;
+
+	free(out);
+	free(entries);
+	free(indices);
+
+	closeFiles(filter.fd, -1);
+	closeFiles(src.fd, dest);
+	return status;
+}
@@ -0,0 +1,81 @@
+#ifndef __FILE_PATTERNS_H
+#define __FILE_PATTERNS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Out-of-core versions of the patterns, for inputs that do not fit in memory. The arrays are
+ * binary files of packed elements, and the filters binary files of ints, in the byte order of
+ * the machine.
+ *
+ * The input is read in chunks of a fixed # bytes, with sequential readahead hints, and the
+ * parallel pattern runs on one chunk at a time. The results are appended to the output file as
+ * each chunk is done, and the chunks of the input are dropped from the page cache once used, so
+ * the memory used stays the same whatever the size of the files. The scan carries the last
+ * result of each chunk into the next one.
+ *
+ * All the calls return -1 with errno set if a file cannot be opened, read or written, or if its
+ * size is not a multiple of the element size.
+ */
+
+// Default # bytes of the chunks
+#define FILE_CHUNK_BYTES (64 * 1024 * 1024)
+
+// Most bytes gather_file reads at once around nearby elements
+#define GATHER_SPAN_BYTES (64 * 1024)
+
+/*
+ * Sets the # bytes of the chunks, or the default if 0.
+ */
+void file_set_chunk_size (size_t bytes);
+
+int map_file (
+  const char *destPath, // Target file
+  const char *srcPath,  // Source file
+  size_t sizeJob,       // Size of each element in the source file
+  void (*worker)(void *v1, const void *v2) // [ v1 = op (v2) ]
+);
+
+/*
+ * dest is left untouched if the source file is empty.
+ */
+int reduce_file (
+  void *dest,           // Target element
+  const char *srcPath,  // Source file
+  size_t sizeJob,       // Size of each element in the source file
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+int scan_file (
+  const char *destPath, // Target file
+  const char *srcPath,  // Source file
+  size_t sizeJob,       // Size of each element in the source file
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+/*
+ * Returns the # elements written, or -1.
+ */
+ssize_t pack_file (
+  const char *destPath, // Target file
+  const char *srcPath,  // Source file
+  size_t sizeJob,       // Size of each element in the source file
+  const char *filterPath // Filter for pack, one int per element of the source file
+);
+
+/*
+ * The elements of the source file are read in the order of the filter, so the source is not
+ * streamed: each chunk of the filter is sorted, and its elements are read with pread in the order
+ * of the file, those within GATHER_SPAN_BYTES of each other with a single read. Nothing of the
+ * source is mapped, so the memory used is that of the chunk (indices, their order and the output)
+ * and of one span per parallel range, whatever the size of the source file.
+ */
+int gather_file (
+  const char *destPath, // Target file
+  const char *srcPath,  // Source file
+  size_t sizeJob,       // Size of each element in the source file
+  const char *filterPath // Filter for gather, indices of the elements of the source file
+);
+
+#endif
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "numa_place.h"
+
+/*
+ * Implementation of the NUMA helpers, over the sysfs node descriptions and the mbind and
+ * sched_setaffinity system calls.
+ * The arrays are mapped directly, with a header page in front that records the mapped size.
+ */
+
+#define NODE_PATH "/sys/devices/system/node"
+
+// Memory policy of mbind (linux/mempolicy.h)
+#define POLICY_INTERLEAVE 3
+
+// Nodes covered by the interleave mask
+#define MAX_NODES 64
+
+// How long numa_each_worker waits for all the workers, in nanoseconds
+#define EACH_WORKER_TIMEOUT 1000000000LL
+
+int numa_count_nodes (void) {
+	DIR *dir = opendir(NODE_PATH);
+	if (dir == NULL)
+		return 1;
+
+	int nodes = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+		if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+			nodes++;
+	closedir(dir);
+
+	return nodes > 0 ? nodes : 1;
+}
+
+// Maps size bytes after a header page, returns the first byte after the header
+static void *mapArray(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t mapped = page + size;
+
+	void *memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return NULL;
+
+	*(size_t *)memory = mapped;
+	return (char *)memory + page;
+}
+
+void numa_release (void *ptr) {
+	if (ptr == NULL)
+		return;
+
+	void *memory = (char *)ptr - sysconf(_SC_PAGESIZE);
+	munmap(memory, *(size_t *)memory);
+}
+
+typedef struct Touch_Args {
+	char *array;
+	size_t nJob;
+	size_t sizeJob;
+	size_t nBlocks;
+	int *touched;         // 1 once the block of each worker is touched
+} Touch_Args;
+
+// Zeroes the i-th of nBlocks blocks of the array, split like the batches of farm
+static void touchBlock(Touch_Args *args, size_t i) {
+	size_t nJob = args->nJob, nBlocks = args->nBlocks;
+	size_t blockSize = nJob / nBlocks + (i < nJob % nBlocks ? 1 : 0);
+	size_t start = i * (nJob / nBlocks) + (i < nJob % nBlocks ? i : nJob % nBlocks);
+
+	memset(args->array + start * args->sizeJob, 0, blockSize * args->sizeJob);
+}
+
+static void touchOwnBlock(void *arg) {
+	Touch_Args *args = arg;
+	size_t id = par_worker_id();
+
+	int untouched = 0;
+	if (id < args->nBlocks && __atomic_compare_exchange_n(&args->touched[id], &untouched, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		touchBlock(args, id);
+}
+
+void *numa_alloc_first_touch (size_t nJob, size_t sizeJob) {
+	Touch_Args args = { mapArray(nJob * sizeJob), nJob, sizeJob, par_nworkers(), NULL };
+	if (args.array == NULL)
+		return NULL;
+
+	args.touched = calloc(args.nBlocks, sizeof(int));
+	if (args.touched == NULL) {
+		numa_release(args.array);
+		return NULL;
+	}
+
+	numa_each_worker(touchOwnBlock, &args);
+
+	// The blocks of the workers that did not show up are placed by the caller
+	for (size_t i = 0; i < args.nBlocks; i++)
+		if (!args.touched[i])
+			touchBlock(&args, i);
+
+	free(args.touched);
+
+	return args.array;
+}
+
+void *numa_alloc_interleave (size_t size) {
+	void *array = mapArray(size);
+	if (array == NULL)
+		return NULL;
+
+	int nodes = numa_count_nodes();
+	if (nodes > 1 && size > 0) {
+		unsigned long mask = nodes >= MAX_NODES ? ~0UL : (1UL << nodes) - 1;
+
+		// Pages are only placed when faulted in, so the policy applies to the whole array
+		syscall(SYS_mbind, array, size, POLICY_INTERLEAVE, &mask, MAX_NODES + 1, 0);
+	}
+
+	return array;
+}
+
+typedef struct Each_Worker {
+	PAR_TASK task;
+	void *arg;
+	size_t nWorkers;
+	size_t arrived;
+	int timedOut;
+} Each_Worker;
+
+static void eachWorkerRange(size_t start, size_t end, void *arg) {
+	Each_Worker *each = arg;
+	struct timespec begin, now;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (size_t i = start; i < end; i++) {
+		each->task(each->arg);
+
+		// Hold the worker, so that the other iterations have to be taken by the other workers
+		__atomic_add_fetch(&each->arrived, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&each->arrived, __ATOMIC_SEQ_CST) < each->nWorkers) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - begin.tv_sec) * 1000000000LL + (now.tv_nsec - begin.tv_nsec) > EACH_WORKER_TIMEOUT) {
+				__atomic_store_n(&each->timedOut, 1, __ATOMIC_SEQ_CST);
+				break;
+			}
+			sched_yield();
+		}
+	}
+}
+
+int numa_each_worker (PAR_TASK task, void *arg) {
+	Each_Worker each = { task, arg, par_nworkers(), 0, 0 };
+
+	par_for(0, each.nWorkers, 1, eachWorkerRange, &each);
+
+	return each.timedOut ? -1 : 0;
+}
+
+// Adds the CPUs of a sysfs cpulist ("0-7,16-23") to the set, returns the # CPUs added
+static int parseCpuList(const char *list, cpu_set_t *set) {
+	int count = 0;
+
+	while (*list != '\0' && *list != '\n') {
+		char *end;
+		long first = strtol(list, &end, 10);
+		long last = first;
+		if (end == list)
+			break;
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+
+		for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++, count++)
+			CPU_SET(cpu, set);
+
+		list = *end == ',' ? end + 1 : end;
+	}
+
+	return count;
+}
+
+typedef struct Pin_Args {
+	int nodes;
+	int nWorkers;
+	int failed;
+} Pin_Args;
+
+static void pinWorker(void *arg) {
+	Pin_Args *args = arg;
+	int id = par_worker_id();
+	int node = id < args->nWorkers ? id * args->nodes / args->nWorkers : args->nodes - 1;
+
+	char path[64];
+	snprintf(path, sizeof(path), NODE_PATH "/node%d/cpulist", node);
+
+	char list[1024];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	FILE *fp = fopen(path, "r");
+	if (fp != NULL) {
+		if (fgets(list, sizeof(list), fp) == NULL)
+			list[0] = '\0';
+		fclose(fp);
+
+		if (parseCpuList(list, &set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0)
+			return;
+	}
+
+	__atomic_store_n(&args->failed, 1, __ATOMIC_RELAXED);
+}
+
+int numa_pin_workers (void) {
+	Pin_Args args = { numa_count_nodes(), par_nworkers(), 0 };
+
+	if (numa_each_worker(pinWorker, &args) != 0)
+		return -1;
+
+	return args.failed ? -1 : 0;
+}
@@ -0,0 +1,53 @@
+#ifndef __NUMA_PLACE_H
+#define __NUMA_PLACE_H
+
+#include <stddef.h>
+#include "parallel.h"
+
+/*
+ * Placement of arrays and workers on the NUMA nodes of the machine.
+ * Linux places a page on the node of the thread that first writes to it, so an array filled by
+ * the calling thread ends up on a single node, and the workers of the other nodes then read it
+ * remotely. The helpers below either fault the pages in from the workers, each one a static block
+ * of the array, or interleave them among all the nodes. They work without libnuma, and
+ * fall back to the default placement when the kernel does not allow the requested policy.
+ */
+
+/*
+ * # NUMA nodes of the machine (1 when it has no NUMA information).
+ */
+int numa_count_nodes (void);
+
+/*
+ * Allocates a zeroed array of nJob elements of sizeJob bytes, split in par_nworkers() blocks like
+ * the batches of farm, and has the worker of id i first touch block i through numa_each_worker,
+ * so that each block lands on the node of its worker. The blocks of workers that do not show up
+ * in time are touched by the caller. Loops that balance their ranges dynamically, like map, do
+ * not always give a worker the block it placed, so for them the placement is best effort.
+ */
+void *numa_alloc_first_touch (size_t nJob, size_t sizeJob);
+
+/*
+ * Allocates size bytes whose pages are interleaved among all the nodes.
+ */
+void *numa_alloc_interleave (size_t size);
+
+/*
+ * Releases an array of numa_alloc_first_touch or numa_alloc_interleave.
+ */
+void numa_release (void *ptr);
+
+/*
+ * Runs task(arg) once on every worker. Each worker is held until all the others have started
+ * theirs, so that no worker runs it twice. Returns -1 if some workers did not show up in time
+ * (they were busy elsewhere), in which case the task may have run fewer or more times.
+ */
+int numa_each_worker (PAR_TASK task, void *arg);
+
+/*
+ * Pins the workers to the CPUs of the nodes, in blocks: the first par_nworkers()/nodes workers
+ * on node 0, and so on. Must be called outside of any parallel work. Returns 0 on success.
+ */
+int numa_pin_workers (void);
+
+#endif
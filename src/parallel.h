@@ -0,0 +1,115 @@
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include <stddef.h>
+
+/*
+ * Threading backend of the patterns, selected at build time (make BACKEND=...):
+ *   cilk      PAR_BACKEND_CILK      Cilk Plus runtime (-fcilkplus)
+ *   omp       PAR_BACKEND_OMP       OpenMP tasks (-fopenmp)
+ *   pthreads  PAR_BACKEND_PTHREADS  built-in work-stealing scheduler over POSIX threads
+ *
+ * Parallel loops take their body as a function over a range of iterations, and fork-join
+ * parallelism is expressed with par_invoke, or with PAR_FRAME / PAR_SPAWN / PAR_SYNC when the
+ * number of children is not known in advance:
+ *
+ *   PAR_FRAME;
+ *   for (...)
+ *     PAR_SPAWN(task, arg);
+ *   PAR_SYNC;
+ *
+ * Every function with a PAR_SPAWN must end its spawns with a PAR_SYNC before returning.
+ */
+
+#if !defined(PAR_BACKEND_CILK) && !defined(PAR_BACKEND_OMP) && !defined(PAR_BACKEND_PTHREADS)
+#define PAR_BACKEND_CILK
+#endif
+
+typedef void (*PAR_TASK)(void *arg);
+
+typedef void (*PAR_RANGE)(size_t start, size_t end, void *arg);
+
+/*
+ * Name of the backend the library was built with.
+ */
+const char *par_backend_name (void);
+
+/*
+ * # workers that execute parallel work (replaces __cilkrts_get_nworkers).
+ */
+int par_nworkers (void);
+
+/*
+ * Upper bound of the worker ids, which are in [0, par_total_workers()).
+ */
+int par_total_workers (void);
+
+/*
+ * Id of the calling worker.
+ */
+int par_worker_id (void);
+
+/*
+ * Changes the # workers. Must be called outside of any parallel work.
+ * Returns 0 on success.
+ */
+int par_set_nworkers (int nWorkers);
+
+/*
+ * Runs task(arg) with the workers of the backend available to its spawns.
+ * Functions that use PAR_SPAWN at their top level should be entered through par_run.
+ */
+void par_run (PAR_TASK task, void *arg);
+
+/*
+ * Runs body over [start, end) in parallel, in ranges of about grain iterations
+ * (grain == 0 picks a few ranges per worker).
+ */
+void par_for (size_t start, size_t end, size_t grain, PAR_RANGE body, void *arg);
+
+/*
+ * Runs f(fArg) and g(gArg) in parallel, and returns when both are done.
+ */
+void par_invoke (PAR_TASK f, void *fArg, PAR_TASK g, void *gArg);
+
+// Ranges per worker of par_for with an automatic grain
+#define PAR_RANGES_PER_WORKER 8
+
+static inline size_t par_grain (size_t n, size_t grain) {
+	if (grain == 0)
+		grain = n / (PAR_RANGES_PER_WORKER * par_nworkers());
+	return grain == 0 ? 1 : grain;
+}
+
+#if defined(PAR_BACKEND_CILK)
+
+#include <cilk/cilk.h>
+
+#define PAR_FRAME
+#define PAR_SPAWN(task, arg) do { cilk_spawn task(arg); } while (0)
+#define PAR_SYNC cilk_sync
+
+#elif defined(PAR_BACKEND_OMP)
+
+#define PAR_FRAME
+#define PAR_SPAWN(task, arg) do { _Pragma("omp task") task(arg); } while (0)
+#define PAR_SYNC _Pragma("omp taskwait")
+
+#else
+
+// Children of a function that are not finished yet
+typedef struct Par_Frame {
+	size_t pending;
+} Par_Frame;
+
+void par_spawn (Par_Frame *frame, PAR_TASK task, void *arg);
+
+void par_sync (Par_Frame *frame);
+
+#define PAR_FRAME Par_Frame par_frame = { 0 }
+#define PAR_SPAWN(task, arg) par_spawn(&par_frame, task, arg)
+#define PAR_SYNC par_sync(&par_frame)
+
+#endif
+
+#endif
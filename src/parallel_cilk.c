@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include "cilk/cilk.h"
+#include "cilk/cilk_api.h"
+#include "parallel.h"
+
+/*
+ * Cilk Plus backend: a thin layer over cilk_for, cilk_spawn and the runtime API.
+ */
+
+const char *par_backend_name (void) {
+	return "cilk";
+}
+
+int par_nworkers (void) {
+	return __cilkrts_get_nworkers();
+}
+
+int par_total_workers (void) {
+	return __cilkrts_get_total_workers();
+}
+
+int par_worker_id (void) {
+	return __cilkrts_get_worker_number();
+}
+
+int par_set_nworkers (int nWorkers) {
+	char value[16];
+	snprintf(value, sizeof(value), "%d", nWorkers);
+
+	// The runtime only takes a new # workers while it is stopped, it restarts on the next spawn
+	__cilkrts_end_cilk();
+	return __cilkrts_set_param("nworkers", value);
+}
+
+void par_run (PAR_TASK task, void *arg) {
+	task(arg);
+}
+
+void par_for (size_t start, size_t end, size_t grain, PAR_RANGE body, void *arg) {
+	if (end <= start)
+		return;
+
+	grain = par_grain(end - start, grain);
+	size_t nRanges = (end - start + grain - 1) / grain;
+
+	cilk_for (size_t i = 0; i < nRanges; i++) {
+		size_t first = start + i * grain;
+		body(first, first + grain < end ? first + grain : end, arg);
+	}
+}
+
+void par_invoke (PAR_TASK f, void *fArg, PAR_TASK g, void *gArg) {
+	cilk_spawn f(fArg);
+	g(gArg);
+	cilk_sync;
+}
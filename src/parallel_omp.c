@@ -0,0 +1,92 @@
+#include <omp.h>
+#include "parallel.h"
+
+/*
+ * OpenMP backend: parallel work is expressed with tasks. Calls made outside of a parallel region
+ * open one, with a single thread creating the tasks that the rest of the team executes.
+ */
+
+const char *par_backend_name (void) {
+	return "omp";
+}
+
+int par_nworkers (void) {
+	return omp_in_parallel() ? omp_get_num_threads() : omp_get_max_threads();
+}
+
+int par_total_workers (void) {
+	int team = omp_get_num_threads();
+	int max = omp_get_max_threads();
+	return team > max ? team : max;
+}
+
+int par_worker_id (void) {
+	return omp_get_thread_num();
+}
+
+int par_set_nworkers (int nWorkers) {
+	omp_set_num_threads(nWorkers);
+	return 0;
+}
+
+void par_run (PAR_TASK task, void *arg) {
+	if (omp_in_parallel()) {
+		task(arg);
+		return;
+	}
+
+	#pragma omp parallel
+	#pragma omp single
+	task(arg);
+}
+
+static void forRanges (size_t start, size_t end, size_t grain, PAR_RANGE body, void *arg) {
+	size_t nRanges = (end - start + grain - 1) / grain;
+
+	#pragma omp taskloop grainsize(1)
+	for (size_t i = 0; i < nRanges; i++) {
+		size_t first = start + i * grain;
+		body(first, first + grain < end ? first + grain : end, arg);
+	}
+}
+
+void par_for (size_t start, size_t end, size_t grain, PAR_RANGE body, void *arg) {
+	if (end <= start)
+		return;
+
+	grain = par_grain(end - start, grain);
+
+	if (end - start <= grain) {
+		body(start, end, arg);
+		return;
+	}
+
+	if (omp_in_parallel()) {
+		forRanges(start, end, grain, body, arg);
+		return;
+	}
+
+	#pragma omp parallel
+	#pragma omp single
+	forRanges(start, end, grain, body, arg);
+}
+
+static void invoke (PAR_TASK f, void *fArg, PAR_TASK g, void *gArg) {
+	#pragma omp task
+	f(fArg);
+
+	g(gArg);
+
+	#pragma omp taskwait
+}
+
+void par_invoke (PAR_TASK f, void *fArg, PAR_TASK g, void *gArg) {
+	if (omp_in_parallel()) {
+		invoke(f, fArg, g, gArg);
+		return;
+	}
+
+	#pragma omp parallel
+	#pragma omp single
+	invoke(f, fArg, g, gArg);
+}
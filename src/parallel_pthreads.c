@@ -0,0 +1,485 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "parallel.h"
+
+/*
+ * Work-stealing backend over POSIX threads.
+ *
+ * Each worker owns a deque of spawned tasks: the owner pushes and pops at the bottom, so it runs
+ * its most recent (and cache-hot) work first, while idle workers steal from the top, taking the
+ * oldest and usually largest pieces of work. A worker that reaches a sync keeps running tasks
+ * until all the children of the frame are done, so workers never block on each other: the
+ * children of the frame itself, and other tasks, popped or stolen, only while fewer than
+ * SYNC_MAX_DEPTH of those are nested on its stack, since each one runs on top of the sync.
+ * Threads that are not workers hand their work to the pool as a root task and sleep until it
+ * is done.
+ */
+
+// Spawned task, queued in the deque of the worker that spawned it
+typedef struct Par_Task {
+	PAR_TASK task;
+	void *arg;
+	Par_Frame *frame;       // Frame waiting for the task
+	int allocated;          // 1 if the task must be freed once done
+} Par_Task;
+
+typedef struct Par_Worker {
+	int id;
+	pthread_t thread;
+	int lock;               // Spinlock of the deque
+	Par_Task **tasks;       // Circular deque, tasks[top..bottom) modulo capacity
+	size_t capacity;
+	size_t top;
+	size_t bottom;
+	unsigned int seed;      // Victim selection
+	int depth;              // # tasks of other frames being run by syncs on the stack
+} Par_Worker;
+
+// Work submitted by a thread outside of the pool
+typedef struct Par_Root {
+	PAR_TASK task;
+	void *arg;
+	int done;
+	struct Par_Root *next;
+} Par_Root;
+
+// Initial capacity of the deques
+#define DEQUE_CAPACITY 256
+
+// Failed attempts to find work before an idle worker goes to sleep
+#define IDLE_SPINS 64
+
+// Longest sleep of an idle worker, in case a wake up is missed
+#define IDLE_SLEEP_NS 1000000
+
+// Most tasks of other frames that syncs run nested on the stack of a worker
+#define SYNC_MAX_DEPTH 32
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;      // Signalled when work is available
+static pthread_cond_t pool_roots_done = PTHREAD_COND_INITIALIZER; // Broadcast when a root is done
+
+static Par_Worker *workers = NULL;
+static int n_workers = 0;
+static int pool_started = 0;
+static int pool_stopping = 0;
+static int sleepers = 0;
+
+static Par_Root *roots_head = NULL;
+static Par_Root *roots_tail = NULL;
+
+static __thread Par_Worker *self = NULL;
+
+static void lockDeque(Par_Worker *worker) {
+	while (__atomic_exchange_n(&worker->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&worker->lock, __ATOMIC_RELAXED))
+			;
+}
+
+static void unlockDeque(Par_Worker *worker) {
+	__atomic_store_n(&worker->lock, 0, __ATOMIC_RELEASE);
+}
+
+static void wakeSleepers(void) {
+	if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&pool_lock);
+		pthread_cond_broadcast(&pool_work);
+		pthread_mutex_unlock(&pool_lock);
+	}
+}
+
+static void pushBottom(Par_Worker *worker, Par_Task *task) {
+	lockDeque(worker);
+
+	if (worker->bottom - worker->top == worker->capacity) {
+		Par_Task **tasks = malloc(2 * worker->capacity * sizeof(Par_Task*));
+		assert (tasks != NULL);
+		for (size_t i = worker->top; i < worker->bottom; i++)
+			tasks[i % (2 * worker->capacity)] = worker->tasks[i % worker->capacity];
+		free(worker->tasks);
+		worker->tasks = tasks;
+		worker->capacity *= 2;
+	}
+
+	worker->tasks[worker->bottom % worker->capacity] = task;
+	worker->bottom++;
+
+	unlockDeque(worker);
+
+	wakeSleepers();
+}
+
+static Par_Task *popBottom(Par_Worker *worker) {
+	Par_Task *task = NULL;
+
+	lockDeque(worker);
+	if (worker->bottom > worker->top) {
+		worker->bottom--;
+		task = worker->tasks[worker->bottom % worker->capacity];
+	}
+	unlockDeque(worker);
+
+	return task;
+}
+
+// Pops the bottom task of the deque if it is a child of the frame
+static Par_Task *popChild(Par_Worker *worker, Par_Frame *frame) {
+	Par_Task *task = NULL;
+
+	lockDeque(worker);
+	if (worker->bottom > worker->top && worker->tasks[(worker->bottom - 1) % worker->capacity]->frame == frame) {
+		worker->bottom--;
+		task = worker->tasks[worker->bottom % worker->capacity];
+	}
+	unlockDeque(worker);
+
+	return task;
+}
+
+static Par_Task *stealTop(Par_Worker *victim) {
+	Par_Task *task = NULL;
+
+	if (__atomic_load_n(&victim->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&victim->top, __ATOMIC_RELAXED))
+		return NULL;
+
+	lockDeque(victim);
+	if (victim->bottom > victim->top) {
+		task = victim->tasks[victim->top % victim->capacity];
+		victim->top++;
+	}
+	unlockDeque(victim);
+
+	return task;
+}
+
+static Par_Task *findTask(Par_Worker *worker) {
+	Par_Task *task = popBottom(worker);
+	if (task != NULL)
+		return task;
+
+	// Try every other worker, starting from a random one
+	int first = rand_r(&worker->seed) % n_workers;
+	for (int i = 0; i < n_workers; i++) {
+		Par_Worker *victim = &workers[(first + i) % n_workers];
+		if (victim != worker && (task = stealTop(victim)) != NULL)
+			return task;
+	}
+
+	return NULL;
+}
+
+static void runTask(Par_Task *task) {
+	task->task(task->arg);
+
+	// The frame may be gone as soon as its counter drops, so the task is released first
+	Par_Frame *frame = task->frame;
+	if (task->allocated)
+		free(task);
+	__atomic_fetch_sub(&frame->pending, 1, __ATOMIC_ACQ_REL);
+}
+
+static Par_Root *takeRoot(void) {
+	Par_Root *root = NULL;
+
+	if (__atomic_load_n(&roots_head, __ATOMIC_RELAXED) == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&pool_lock);
+	if (roots_head != NULL) {
+		root = roots_head;
+		roots_head = root->next;
+		if (roots_head == NULL)
+			roots_tail = NULL;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	return root;
+}
+
+static void runRoot(Par_Root *root) {
+	root->task(root->arg);
+
+	pthread_mutex_lock(&pool_lock);
+	root->done = 1;
+	pthread_cond_broadcast(&pool_roots_done);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+static void sleepUntilWork(void) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += IDLE_SLEEP_NS;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	__atomic_fetch_add(&sleepers, 1, __ATOMIC_SEQ_CST);
+	if (roots_head == NULL && !pool_stopping)
+		pthread_cond_timedwait(&pool_work, &pool_lock, &deadline);
+	__atomic_fetch_sub(&sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+static void *workerLoop(void *arg) {
+	self = arg;
+	int idle = 0;
+
+	while (!__atomic_load_n(&pool_stopping, __ATOMIC_ACQUIRE)) {
+		Par_Task *task = findTask(self);
+		if (task != NULL) {
+			runTask(task);
+			idle = 0;
+			continue;
+		}
+
+		Par_Root *root = takeRoot();
+		if (root != NULL) {
+			runRoot(root);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < IDLE_SPINS)
+			sched_yield();
+		else
+			sleepUntilWork();
+	}
+
+	return NULL;
+}
+
+static int defaultWorkers(void) {
+	const char *env = getenv("PAR_NWORKERS");
+	int n = env != NULL ? atoi(env) : 0;
+
+	if (n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
+// Starts the pool on first use; must be called with pool_lock held
+static void startPool(void) {
+	if (pool_started)
+		return;
+
+	if (n_workers <= 0)
+		n_workers = defaultWorkers();
+
+	workers = calloc(n_workers, sizeof(Par_Worker));
+	assert (workers != NULL);
+
+	pool_stopping = 0;
+	for (int i = 0; i < n_workers; i++) {
+		workers[i].id = i;
+		workers[i].capacity = DEQUE_CAPACITY;
+		workers[i].tasks = malloc(DEQUE_CAPACITY * sizeof(Par_Task*));
+		workers[i].seed = i + 1;
+		assert (workers[i].tasks != NULL);
+	}
+	for (int i = 0; i < n_workers; i++) {
+		int error = pthread_create(&workers[i].thread, NULL, workerLoop, &workers[i]);
+		assert (error == 0);
+		(void) error;
+	}
+
+	pool_started = 1;
+}
+
+// Stops the pool, if it is idle; must be called with pool_lock held
+static void stopPool(void) {
+	if (!pool_started)
+		return;
+
+	__atomic_store_n(&pool_stopping, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+
+	for (int i = 0; i < n_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	pthread_mutex_lock(&pool_lock);
+	for (int i = 0; i < n_workers; i++)
+		free(workers[i].tasks);
+	free(workers);
+	workers = NULL;
+	pool_started = 0;
+}
+
+const char *par_backend_name (void) {
+	return "pthreads";
+}
+
+int par_nworkers (void) {
+	int n = __atomic_load_n(&n_workers, __ATOMIC_ACQUIRE);
+	if (n > 0)
+		return n;
+
+	pthread_mutex_lock(&pool_lock);
+	if (n_workers <= 0)
+		__atomic_store_n(&n_workers, defaultWorkers(), __ATOMIC_RELEASE);
+	n = n_workers;
+	pthread_mutex_unlock(&pool_lock);
+
+	return n;
+}
+
+// Threads outside of the pool run small loops inline, they share the id after the workers
+int par_total_workers (void) {
+	return par_nworkers() + 1;
+}
+
+int par_worker_id (void) {
+	return self != NULL ? self->id : par_nworkers();
+}
+
+int par_set_nworkers (int nWorkers) {
+	if (nWorkers <= 0 || self != NULL)
+		return -1;
+
+	pthread_mutex_lock(&pool_lock);
+	stopPool();
+	n_workers = nWorkers;
+	pthread_mutex_unlock(&pool_lock);
+
+	return 0;
+}
+
+void par_run (PAR_TASK task, void *arg) {
+	if (self != NULL) {
+		task(arg);
+		return;
+	}
+
+	Par_Root root = { task, arg, 0, NULL };
+
+	pthread_mutex_lock(&pool_lock);
+	startPool();
+	if (roots_tail == NULL)
+		roots_head = &root;
+	else
+		roots_tail->next = &root;
+	roots_tail = &root;
+	pthread_cond_broadcast(&pool_work);
+
+	while (!root.done)
+		pthread_cond_wait(&pool_roots_done, &pool_lock);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void par_spawn (Par_Frame *frame, PAR_TASK task, void *arg) {
+	// Outside of the pool there is no deque to queue the task in
+	if (self == NULL) {
+		task(arg);
+		return;
+	}
+
+	Par_Task *spawned = malloc(sizeof(Par_Task));
+	assert (spawned != NULL);
+
+	spawned->task = task;
+	spawned->arg = arg;
+	spawned->frame = frame;
+	spawned->allocated = 1;
+
+	__atomic_fetch_add(&frame->pending, 1, __ATOMIC_ACQ_REL);
+	pushBottom(self, spawned);
+}
+
+void par_sync (Par_Frame *frame) {
+	while (__atomic_load_n(&frame->pending, __ATOMIC_ACQUIRE) > 0) {
+		Par_Task *task = popChild(self, frame);
+		if (task != NULL) {
+			runTask(task);
+			continue;
+		}
+
+		// Other tasks run on top of this sync, so their nesting is bounded
+		if (self->depth < SYNC_MAX_DEPTH && (task = findTask(self)) != NULL) {
+			self->depth++;
+			runTask(task);
+			self->depth--;
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+typedef struct Invoke_Args {
+	PAR_TASK f;
+	void *fArg;
+	PAR_TASK g;
+	void *gArg;
+} Invoke_Args;
+
+static void invoke(void *arg) {
+	Invoke_Args *args = arg;
+
+	// The task lives in this frame, which does not return before the task is done
+	Par_Frame frame = { 1 };
+	Par_Task spawned = { args->f, args->fArg, &frame, 0 };
+	pushBottom(self, &spawned);
+
+	args->g(args->gArg);
+
+	par_sync(&frame);
+}
+
+void par_invoke (PAR_TASK f, void *fArg, PAR_TASK g, void *gArg) {
+	Invoke_Args args = { f, fArg, g, gArg };
+
+	if (self == NULL)
+		par_run(invoke, &args);
+	else
+		invoke(&args);
+}
+
+typedef struct For_Args {
+	size_t start;
+	size_t end;
+	size_t grain;
+	PAR_RANGE body;
+	void *arg;
+} For_Args;
+
+// Splits the range in halves, spawning the upper one, until it is down to the grain
+static void forRange(void *arg) {
+	For_Args *args = arg;
+
+	if (args->end - args->start <= args->grain) {
+		args->body(args->start, args->end, args->arg);
+		return;
+	}
+
+	size_t mid = args->start + (args->end - args->start) / 2;
+	For_Args lower = { args->start, mid, args->grain, args->body, args->arg };
+	For_Args upper = { mid, args->end, args->grain, args->body, args->arg };
+
+	Par_Frame frame = { 1 };
+	Par_Task spawned = { forRange, &upper, &frame, 0 };
+	pushBottom(self, &spawned);
+
+	forRange(&lower);
+
+	par_sync(&frame);
+}
+
+void par_for (size_t start, size_t end, size_t grain, PAR_RANGE body, void *arg) {
+	if (end <= start)
+		return;
+
+	For_Args args = { start, end, par_grain(end - start, grain), body, arg };
+
+	if (end - start <= args.grain)
+		body(start, end, arg);
+	else if (self == NULL)
+		par_run(forRange, &args);
+	else
+		forRange(&args);
+}
@@ -1,11 +1,12 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
 #include "patterns.h"
-#include "prefix_scan.h"
-#include "cilk/cilk.h"
-#include "cilk/cilk_api.h"
-#include "prefix_scan.h"
+#include "variants.h"
+#include "parallel.h"
+#include "arena.h"
 
 #include <stdio.h>
 
@@ -14,6 +15,9 @@
 #define SUM_NEUTRAL 0.0
 #define MULT_NEUTRAL 1.0
 
+// # items timed by pipeline_farm_stages to balance the stages
+#define PIPELINE_SAMPLE 16
+
 
 //custom workers
 static void auxWorkerAdd(void* a, const void* b, const void* c) {
@@ -26,15 +30,40 @@ static void auxWorkerAdd(void* a, const void* b, const void* c) {
 }
 
 
+/*
+ * Arguments of the loop bodies run by par_for, which only take a range of iterations and a pointer.
+ */
+typedef struct Map_Args {
+	void *dest;
+	void *src;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2);
+} Map_Args;
+
+static void mapRange(size_t start, size_t end, void *arg) {
+	Map_Args *args = arg;
+	for (size_t i = start; i < end; i++)
+		args->worker(args->dest + i * args->sizeJob, args->src + i * args->sizeJob);
+}
+
+typedef struct Copy_Args {
+	void *dest;
+	void *src;
+	size_t sizeJob;
+} Copy_Args;
+
+static void copyRange(size_t start, size_t end, void *arg) {
+	Copy_Args *args = arg;
+	memcpy(args->dest + start * args->sizeJob, args->src + start * args->sizeJob, (end - start) * args->sizeJob);
+}
+
 void map (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2)) {
 	assert (dest != NULL);
 	assert (src != NULL);
 	assert (worker != NULL);
 
-	// Define the grainsize
-	//#pragma cilk grainsize = max(1024, min(nJob/(__cilkrts_get_nworkers()), 2048))
-	cilk_for (size_t i = 0; i < nJob; i++)
-		worker(dest + i * sizeJob, src + i * sizeJob);
+	Map_Args args = { dest, src, sizeJob, worker };
+	par_for(0, nJob, 0, mapRange, &args);
 }
 
 void map_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2)) {
@@ -46,6 +75,33 @@ void map_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)
 	}
 }
 
+typedef struct Reduce_Args {
+	void *write;
+	void *read;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+	size_t tileSize;
+	size_t tileRemainder;
+} Reduce_Args;
+
+static void reducePairs(size_t start, size_t end, void *arg) {
+	Reduce_Args *args = arg;
+	size_t sizeJob = args->sizeJob;
+	for (size_t curr_tile = start; curr_tile < end; curr_tile++)
+		args->worker(args->write + curr_tile * sizeJob, args->read + (2 * curr_tile) * sizeJob, args->read + (2 * curr_tile + 1) * sizeJob);
+}
+
+static void reduceTiles(size_t start, size_t end, void *arg) {
+	Reduce_Args *args = arg;
+	size_t sizeJob = args->sizeJob, tileSize = args->tileSize, tile_remainder = args->tileRemainder;
+	for (size_t curr_tile = start; curr_tile < end; curr_tile++) {
+		void *work_start = args->read + sizeJob * (curr_tile * tileSize + (curr_tile < tile_remainder ? curr_tile : tile_remainder));
+		size_t work_size = tileSize + (curr_tile < tile_remainder ? 1 : 0);
+		void *writeTo = args->write + curr_tile * sizeJob;
+		reduce_seq(writeTo, work_start, work_size, sizeJob, args->worker);
+	}
+}
+
 void reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
 		void (*worker)(void *v1, const void *v2, const void *v3))
 {
@@ -57,16 +113,16 @@ void reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
 	size_t tile_remainder;
 
 	void *read = src;
-	void *write = malloc((num_tiles / 2) * sizeJob);
+	void *write = scratch_alloc((num_tiles / 2) * sizeJob);
 
-	void *aux = malloc((num_tiles / 4) * sizeJob);
+	void *aux = scratch_alloc((num_tiles / 4) * sizeJob);
 
 	while(num_tiles > 1) {
 		tile_remainder = num_tiles % 2;
 		num_tiles = num_tiles / 2;
 
-		cilk_for(size_t curr_tile = 0; curr_tile < num_tiles; curr_tile ++)
-			worker(write + curr_tile * sizeJob, read + (2 * curr_tile) * sizeJob, read + (2 * curr_tile + 1) * sizeJob);
+		Reduce_Args args = { write, read, sizeJob, worker, 2, tile_remainder };
+		par_for(0, num_tiles, 0, reducePairs, &args);
 
 		if(tile_remainder == 1)
 			worker(write, write, read + num_tiles * 2 * sizeJob);
@@ -76,11 +132,12 @@ void reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
 		aux = read;
 	}
 
-	if(num_tiles != nJob)
+	// A single element is its own reduction, read is still src then
+	if(nJob > 0)
 		memcpy(dest, read, sizeJob);
 
-	free(aux);
-	free(write);
+	scratch_free(aux);
+	scratch_free(write);
 }
 
 void tiled_reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
@@ -97,20 +154,16 @@ void tiled_reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
 	void *read = src;
 
 	// the below memory zones only get allocated if tiled reduce is to actually occur; otherwise sequential reduce will take place and the memory would not be necessary
-	void *write = (num_tiles / tileSize) <= 1 ? NULL : malloc((num_tiles / tileSize) * sizeJob); // maximum size must be the number of tiles for the first reduce step
+	void *write = (num_tiles / tileSize) <= 1 ? NULL : scratch_alloc((num_tiles / tileSize) * sizeJob); // maximum size must be the number of tiles for the first reduce step
 
-	void *aux = (num_tiles / tileSize) <= 1 ? NULL : malloc((num_tiles / tileSize / tileSize) * sizeJob); // maximum size must be the number of tiles for the second reduce step
+	void *aux = (num_tiles / tileSize) <= 1 ? NULL : scratch_alloc((num_tiles / tileSize / tileSize) * sizeJob); // maximum size must be the number of tiles for the second reduce step
 
 	while(num_tiles / tileSize > 1) {	// while it is possible to have more than one tile of tileSize
 		tile_remainder = num_tiles % tileSize;
 		num_tiles = num_tiles / tileSize;	// get the number of tiles
 
-		cilk_for(size_t curr_tile = 0; curr_tile < num_tiles; curr_tile++) {
-			void *work_start = read + sizeJob * (curr_tile * tileSize + (curr_tile < tile_remainder ? curr_tile : tile_remainder));
-			size_t work_size = tileSize + (curr_tile < tile_remainder ? 1 : 0);
-			void *writeTo = write + curr_tile * sizeJob;
-			reduce_seq(writeTo, work_start, work_size, sizeJob, worker);
-		}
+		Reduce_Args args = { write, read, sizeJob, worker, tileSize, tile_remainder };
+		par_for(0, num_tiles, 0, reduceTiles, &args);
 
 		read = write;
 		write = aux;
@@ -119,8 +172,8 @@ void tiled_reduce (void *dest, void *src, size_t nJob,  size_t sizeJob,
 
 	reduce_seq(dest, read, num_tiles, sizeJob, worker);
 
-	free(aux);
-	free(write);
+	scratch_free(aux);
+	scratch_free(write);
 }
 
 void reduce_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
@@ -128,7 +181,7 @@ void reduce_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*work
 	assert (src != NULL);
 	assert (worker != NULL);
 
-	if (nJob > 1) {
+	if (nJob > 0) {
 		memcpy (dest, src, sizeJob);
 		for (int i = 1;  i < nJob;  i++)
 			worker(dest, dest, src + i * sizeJob);
@@ -140,20 +193,70 @@ void scan(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(voi
 	assert (src != NULL);
 	assert (worker != NULL);
 
-	prefix_scan(src, dest, nJob, sizeJob, worker);
+	// The prefix scan tree is the one selected in the variant registry
+	if (nJob > 0)
+		variant_scan(dest, src, nJob, sizeJob, worker);
 }
 
 void scan_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
 	assert (dest != NULL);
 	assert (src != NULL);
 	assert (worker != NULL);
-	if (nJob > 1) {
+	if (nJob > 0) {
 		memcpy (dest, src, sizeJob);
 		for (int i = 1;  i < nJob;  i++)
 			worker(dest + i * sizeJob, src + i * sizeJob, dest + (i-1) * sizeJob);
 	}
 }
 
+typedef struct Scan_Args {
+	void *dest;
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+} Scan_Args;
+
+static void scanTask(void *arg) {
+	Scan_Args *args = arg;
+	scan(args->dest, args->src, args->nJob, args->sizeJob, args->worker);
+}
+
+typedef struct Filter_Args {
+	void *dest;
+	void *src;
+	size_t sizeJob;
+	const int *filter;
+	int *invertedFilter;
+	const int *positivesBitSum;
+	const int *negativesBitSum;
+	size_t offset;
+} Filter_Args;
+
+static void invertRange(size_t start, size_t end, void *arg) {
+	Filter_Args *args = arg;
+	for (size_t i = start; i < end; i++)
+		args->invertedFilter[i] = 1 - args->filter[i];
+}
+
+static void splitRange(size_t start, size_t end, void *arg) {
+	Filter_Args *args = arg;
+	for (size_t i = start; i < end; i++) {
+		size_t pos =  args->filter[i] ? args->positivesBitSum[i] -1 : args->negativesBitSum[i]-1 + args->offset;
+		memcpy( args->dest + pos*args->sizeJob, args->src + i*args->sizeJob, args->sizeJob);
+	}
+}
+
+static void packRange(size_t start, size_t end, void *arg) {
+	Filter_Args *args = arg;
+	for (size_t i = start; i < end; i++) {
+		if(args->filter[i]){
+			size_t pos = args->positivesBitSum[i] -1;
+			memcpy( args->dest + pos*args->sizeJob, args->src + i*args->sizeJob, args->sizeJob);
+		}
+	}
+}
+
 int split(void* dest, void* src, size_t nJob, size_t sizeJob, const int* filter)
 {
 	assert (dest != NULL);
@@ -161,32 +264,30 @@ int split(void* dest, void* src, size_t nJob, size_t sizeJob, const int* filter)
 	assert (filter != NULL);
 
 	// Invert mask
-	int * invertedFilter = malloc( nJob * sizeof(int) );
-	cilk_for(size_t i = 0; i < nJob; i++){
-		invertedFilter[i] = 1 - filter[i];
-	}
+	int * invertedFilter = scratch_alloc( nJob * sizeof(int) );
+	Filter_Args args = { dest, src, sizeJob, filter, invertedFilter };
+	par_for(0, nJob, 0, invertRange, &args);
 
 	// Calculate positive and negative bitsums
-	int * negativesBitSum = malloc( nJob * sizeof(int) );
-	cilk_spawn scan( (void*) negativesBitSum, invertedFilter, nJob, sizeof(int) ,auxWorkerAdd);
+	int * negativesBitSum = scratch_alloc( nJob * sizeof(int) );
+	Scan_Args negatives = { negativesBitSum, invertedFilter, nJob, sizeof(int), auxWorkerAdd };
 
-	int * positivesBitSum = malloc( nJob * sizeof(int) );
-	scan( (void*) positivesBitSum, (void *) filter, nJob, sizeof(int), auxWorkerAdd);
+	int * positivesBitSum = scratch_alloc( nJob * sizeof(int) );
+	Scan_Args positives = { positivesBitSum, (void *) filter, nJob, sizeof(int), auxWorkerAdd };
 
-	cilk_sync;
+	par_invoke(scanTask, &negatives, scanTask, &positives);
 
 	//packing values
 	size_t offset = positivesBitSum[nJob-1];
 
+	args.positivesBitSum = positivesBitSum;
+	args.negativesBitSum = negativesBitSum;
+	args.offset = offset;
+	par_for(0, nJob, 0, splitRange, &args);
 
-	cilk_for(size_t i = 0; i < nJob; i++){
-		size_t pos =  filter[i] ? positivesBitSum[i] -1 : negativesBitSum[i]-1 + offset;
-		memcpy( dest + pos*sizeJob, src + i*sizeJob, sizeJob);
-	}
-
-	free(positivesBitSum);
-	free(negativesBitSum);
-	free(invertedFilter);
+	scratch_free(positivesBitSum);
+	scratch_free(negativesBitSum);
+	scratch_free(invertedFilter);
 
 
 	return offset;
@@ -199,16 +300,16 @@ int split_seq(void* dest, void* src, size_t nJob, size_t sizeJob, const int* fil
 	assert (filter != NULL);
 
 	// Invert mask
-	int * invertedFilter = malloc( nJob * sizeof(int) );
+	int * invertedFilter = scratch_alloc( nJob * sizeof(int) );
 	for(size_t i = 0; i < nJob; i++){
 		invertedFilter[i] = 1 - filter[i];
 	}
 
 	// Calculate positive and negative bitsums
-	int * negativesBitSum = malloc( nJob * sizeof(int) );
+	int * negativesBitSum = scratch_alloc( nJob * sizeof(int) );
 	scan( (void*) negativesBitSum, invertedFilter, nJob, sizeof(int) ,auxWorkerAdd);
 
-	int * positivesBitSum = malloc( nJob * sizeof(int) );
+	int * positivesBitSum = scratch_alloc( nJob * sizeof(int) );
 	scan( (void*) positivesBitSum, (void *) filter, nJob, sizeof(int), auxWorkerAdd);
 
 	// Pack values
@@ -219,9 +320,9 @@ int split_seq(void* dest, void* src, size_t nJob, size_t sizeJob, const int* fil
 		memcpy( dest + pos*sizeJob, src + i*sizeJob, sizeJob);
 	}
 
-	free(positivesBitSum);
-	free(negativesBitSum);
-	free(invertedFilter);
+	scratch_free(positivesBitSum);
+	scratch_free(negativesBitSum);
+	scratch_free(invertedFilter);
 
 
 	return offset;
@@ -234,20 +335,16 @@ int pack (void* dest, void* src, size_t nJob, size_t sizeJob, const int* filter)
 	assert (filter != NULL);
 
 	// Allocate memory for bitsum
-	int *bitSum = malloc( nJob * sizeof(int) );
+	int *bitSum = scratch_alloc( nJob * sizeof(int) );
 
 	// Calculate bitsum
 	scan( (void*) bitSum, (void *) filter, nJob, sizeof(int), auxWorkerAdd);
 
-	cilk_for(size_t i = 0; i < nJob; i++){
-		if(filter[i]){
-			size_t pos = bitSum[i] -1;
-			memcpy( dest + pos*sizeJob, src + i*sizeJob, sizeJob);
-		}
-	}
+	Filter_Args args = { dest, src, sizeJob, filter, NULL, bitSum };
+	par_for(0, nJob, 0, packRange, &args);
 
 	int returnVal = bitSum[nJob-1];
-	free(bitSum);
+	scratch_free(bitSum);
 
 	return returnVal;
 }
@@ -263,14 +360,25 @@ int pack_seq (void *dest, void *src, size_t nJob, size_t sizeJob, const int *fil
 	return pos;
 }
 
+static void gatherRange(size_t start, size_t end, void *arg) {
+	Filter_Args *args = arg;
+	for (size_t i = start; i < end; i++)
+		memcpy (args->dest + i * args->sizeJob, args->src + args->filter[i] * args->sizeJob, args->sizeJob);
+}
+
+static void scatterRange(size_t start, size_t end, void *arg) {
+	Filter_Args *args = arg;
+	for (size_t i = start; i < end; i++)
+		memcpy (args->dest + args->filter[i] * args->sizeJob, args->src + i * args->sizeJob, args->sizeJob);
+}
+
 void gather (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter, int nFilter) {
 	assert (dest != NULL);
 	assert (src != NULL);
 	assert (filter != NULL);
 
-	cilk_for (int i=0; i < nFilter; i++) {
-		memcpy (dest + i * sizeJob, src + filter[i] * sizeJob, sizeJob);
-	}
+	Filter_Args args = { dest, src, sizeJob, filter };
+	par_for(0, nFilter, 0, gatherRange, &args);
 }
 
 void gather_seq (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter, int nFilter) {
@@ -288,9 +396,8 @@ void scatter (void *dest, void *src, size_t nJob, size_t sizeJob, const int *fil
 	assert (src != NULL);
 	assert (filter != NULL);
 
-	cilk_for (int i=0; i < nJob; i++) {
-		memcpy (dest + filter[i] * sizeJob, src + i * sizeJob, sizeJob);
-	}
+	Filter_Args args = { dest, src, sizeJob, filter };
+	par_for(0, nJob, 0, scatterRange, &args);
 }
 
 void scatter_seq (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter) {
@@ -303,46 +410,74 @@ void scatter_seq (void *dest, void *src, size_t nJob, size_t sizeJob, const int
 	}
 }
 
+/*
+ * Stages [start, end) of step i of pipeline: stage j works on item i-j.
+ */
+typedef struct Step_Args {
+	void *dest;
+	size_t sizeJob;
+	void (**workerList)(void *v1, const void *v2);
+	size_t step;
+} Step_Args;
+
+static void stepRange(size_t start, size_t end, void *arg) {
+	Step_Args *args = arg;
+	for (size_t j = start; j < end; j++) {
+		void* job = args->dest + (args->step-j)*args->sizeJob;
+		args->workerList[j](job, job);
+	}
+}
+
 void pipeline (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
 	assert (dest != NULL);
 	assert (src != NULL);
 	assert (workerList != NULL);
 
-	cilk_for(size_t i = 0; i < nJob; i++) {
-		memcpy(dest + i*sizeJob, src + i*sizeJob, sizeJob);
-	}
+	Copy_Args copy = { dest, src, sizeJob };
+	par_for(0, nJob, 0, copyRange, &copy);
+
+	Step_Args args = { dest, sizeJob, workerList };
 
 	// Start of the pipeline
 	size_t limit = nWorkers-1;
 	for(size_t i = 0; i < limit; i++) {
 		// Compute each worker
-		for( size_t j = 0; j <= i; j++) {
-			void* job = dest + (i-j)*sizeJob;
-			cilk_spawn workerList[j](job, job);
-		}
-		cilk_sync;
+		args.step = i;
+		par_for(0, i+1, 1, stepRange, &args);
 	}
 
 	// Normal execution of the pipeline
 	limit = nJob;
 	for(size_t i =  nWorkers-1; i < limit; i++) {
 		// Compute each worker
-		for( size_t j = 0; j < nWorkers; j++) {
-			void* job = dest + (i-j)*sizeJob;
-			cilk_spawn workerList[j](job, job);
-		}
-		cilk_sync;
+		args.step = i;
+		par_for(0, nWorkers, 1, stepRange, &args);
 	}
 
 	// Execute of the ramaining (last) tasks
 	limit = nJob + nWorkers-1;
 	for(size_t i = nJob; i < limit; i++) {
 		// Compute each worker
-		for( size_t j = i - nJob + 1; j < nWorkers; j++) {
-			void* job = dest + (i-j)*sizeJob;
-			cilk_spawn workerList[j](job, job);
-		}
-		cilk_sync;
+		args.step = i;
+		par_for(i - nJob + 1, nWorkers, 1, stepRange, &args);
+	}
+}
+
+/*
+ * Items [first+start, first+end) of a batch of pipeline_farm, all in the same stage.
+ */
+typedef struct Batch_Args {
+	void *dest;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2);
+	size_t first;
+} Batch_Args;
+
+static void batchRange(size_t start, size_t end, void *arg) {
+	Batch_Args *args = arg;
+	for (size_t k = start; k < end; k++) {
+		void* job = args->dest + (args->first+k)*args->sizeJob;
+		args->worker(job, job);
 	}
 }
 
@@ -355,9 +490,10 @@ void pipeline_farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*w
 	if( nFarms == 1)
 		pipeline(dest, src, nJob, sizeJob, workerList, nWorkers);
 	else {
-		cilk_for(size_t i = 0; i < nJob; i++) {
-			memcpy(dest + i*sizeJob, src + i*sizeJob, sizeJob);
-		}
+		Copy_Args copy = { dest, src, sizeJob };
+		par_for(0, nJob, 0, copyRange, &copy);
+
+		Batch_Args args = { dest, sizeJob };
 
 		size_t nBatches = (nJob / nFarms) + ( nJob % nFarms == 0 ? 0 : 1);
 
@@ -368,10 +504,9 @@ void pipeline_farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*w
 			for( int j = 0; j <= i; j++) {
 				size_t length = (i-j == nBatches-1) ? nJob-(nBatches-1)*nFarms : nFarms;
 
-				cilk_for( int k = 0; k < length; k++) {
-					void* job = dest + ((i-j)*nFarms+k)*sizeJob;
-					workerList[j](job, job);
-				}
+				args.first = (i-j)*nFarms;
+				args.worker = workerList[j];
+				par_for(0, length, 1, batchRange, &args);
 			}
 		}
 
@@ -382,10 +517,9 @@ void pipeline_farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*w
 			for( int j = 0; j < nWorkers; j++) {
 				size_t length = (i-j == nBatches-1) ? nJob-(nBatches-1)*nFarms : nFarms;
 
-				cilk_for( int k = 0; k < length; k++) {
-					void* job = dest + ((i-j)*nFarms+k)*sizeJob;
-					workerList[j](job, job);
-				}
+				args.first = (i-j)*nFarms;
+				args.worker = workerList[j];
+				par_for(0, length, 1, batchRange, &args);
 			}
 		}
 
@@ -396,13 +530,473 @@ void pipeline_farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*w
 			for( int j = i - nBatches + 1; j < nWorkers; j++) {
 				size_t length = (i-j == nBatches-1) ? nJob-(nBatches-1)*nFarms : nFarms;
 
-				cilk_for( int k = 0; k < length; k++) {
-					void* job = dest + ((i-j)*nFarms+k)*sizeJob;
-					workerList[j](job, job);
-				}
+				args.first = (i-j)*nFarms;
+				args.worker = workerList[j];
+				par_for(0, length, 1, batchRange, &args);
+			}
+		}
+	}
+}
+
+/*
+ * Location of the input of stage j for an item of pipeline_typed: stage 0 reads the source array,
+ * the others read the slot of the previous stage's double buffer.
+ */
+static void *typedStageInput(void *src, void **buffers, size_t item, const size_t *sizeJob, size_t j) {
+	if (j == 0)
+		return src + item*sizeJob[0];
+	return buffers[j-1] + (item % 2)*sizeJob[j];
+}
+
+static void *typedStageOutput(void *dest, void **buffers, size_t item, const size_t *sizeJob, size_t j, size_t nWorkers) {
+	if (j == nWorkers-1)
+		return dest + item*sizeJob[nWorkers];
+	return buffers[j] + (item % 2)*sizeJob[j+1];
+}
+
+typedef struct Typed_Step_Args {
+	void *dest;
+	void *src;
+	void **buffers;
+	const size_t *sizeJob;
+	void (**workerList)(void *v1, const void *v2);
+	size_t nWorkers;
+	size_t step;
+} Typed_Step_Args;
+
+static void typedStepRange(size_t start, size_t end, void *arg) {
+	Typed_Step_Args *args = arg;
+	for (size_t j = start; j < end; j++) {
+		void *in = typedStageInput(args->src, args->buffers, args->step-j, args->sizeJob, j);
+		void *out = typedStageOutput(args->dest, args->buffers, args->step-j, args->sizeJob, j, args->nWorkers);
+		args->workerList[j](out, in);
+	}
+}
+
+void pipeline_typed (void *dest, void *src, size_t nJob, const size_t *sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (sizeJob != NULL);
+	assert (workerList != NULL);
+	assert (nWorkers > 0);
+
+	// Each stage but the last writes into its own double buffer, sized for its output
+	size_t bufferSize = 0;
+	for (size_t j = 0; j < nWorkers-1; j++)
+		bufferSize += 2 * sizeJob[j+1];
+
+	void *buffer = scratch_alloc(bufferSize);
+	void **buffers = scratch_alloc(nWorkers * sizeof(void*));
+	void *next = buffer;
+	for (size_t j = 0; j < nWorkers-1; j++) {
+		buffers[j] = next;
+		next += 2 * sizeJob[j+1];
+	}
+
+	// At step i, stage j works on item i-j: it writes the slot (i-j) % 2 of its buffer while
+	// the next stage reads the other slot
+	Typed_Step_Args args = { dest, src, buffers, sizeJob, workerList, nWorkers };
+	size_t limit = nJob + nWorkers-1;
+	for (size_t i = 0; i < limit; i++) {
+		size_t firstStage = i < nJob ? 0 : i - nJob + 1;
+		size_t lastStage = i < nWorkers ? i : nWorkers-1;
+
+		args.step = i;
+		par_for(firstStage, lastStage+1, 1, typedStepRange, &args);
+	}
+
+	scratch_free(buffers);
+	scratch_free(buffer);
+}
+
+void pipeline_typed_seq (void *dest, void *src, size_t nJob, const size_t *sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (sizeJob != NULL);
+	assert (workerList != NULL);
+	assert (nWorkers > 0);
+
+	size_t maxSize = 0;
+	for (size_t j = 1; j < nWorkers; j++)
+		if (sizeJob[j] > maxSize)
+			maxSize = sizeJob[j];
+
+	// Ping-pong between two slots large enough for any intermediate
+	void *buffer = scratch_alloc(2 * maxSize);
+
+	for (size_t i = 0; i < nJob; i++) {
+		const void *in = src + i*sizeJob[0];
+		for (size_t j = 0; j < nWorkers; j++) {
+			void *out = (j == nWorkers-1) ? dest + i*sizeJob[nWorkers] : buffer + (j % 2)*maxSize;
+			workerList[j](out, in);
+			in = out;
+		}
+	}
+
+	scratch_free(buffer);
+}
+
+/*
+ * Runs one stage of pipeline_farm_stages over a batch of items, split among the stage replicas.
+ * The first stage also copies its items from src into dest.
+ */
+typedef struct Replica_Args {
+	void *dest;
+	void *src;
+	size_t first;
+	size_t length;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2);
+	size_t replicas;
+} Replica_Args;
+
+static void replicaRange(size_t start, size_t end, void *arg) {
+	Replica_Args *args = arg;
+	size_t sizeJob = args->sizeJob;
+	for (size_t r = start; r < end; r++) {
+		size_t first = args->first + r*args->length/args->replicas;
+		size_t last = args->first + (r+1)*args->length/args->replicas;
+		for (size_t k = first; k < last; k++) {
+			void* job = args->dest + k*sizeJob;
+			if (args->src != NULL)
+				memcpy(job, args->src + k*sizeJob, sizeJob);
+			args->worker(job, job);
+		}
+	}
+}
+
+static void farmStage(void *dest, void *src, size_t first, size_t length, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t replicas) {
+	if (replicas > length)
+		replicas = length;
+	if (replicas < 1)
+		replicas = 1;
+
+	Replica_Args args = { dest, src, first, length, sizeJob, worker, replicas };
+	par_for(0, replicas, 1, replicaRange, &args);
+}
+
+/*
+ * Stages [start, end) of step i of pipeline_farm_stages: stage j works on batch i-j.
+ */
+typedef struct Farm_Step_Args {
+	void *dest;
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	void (**workerList)(void *v1, const void *v2);
+	const size_t *replicas;
+	size_t batchSize;
+	size_t nBatches;
+	size_t step;
+} Farm_Step_Args;
+
+static void farmStepRange(size_t start, size_t end, void *arg) {
+	Farm_Step_Args *args = arg;
+	for (size_t j = start; j < end; j++) {
+		size_t first = (args->step-j)*args->batchSize;
+		size_t length = (args->step-j == args->nBatches-1) ? args->nJob - first : args->batchSize;
+		farmStage(args->dest, j == 0 ? args->src : NULL, first, length, args->sizeJob, args->workerList[j], args->replicas[j]);
+	}
+}
+
+static long long elapsedNanoseconds(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000000000LL + (end.tv_nsec - start->tv_nsec);
+}
+
+void pipeline_farm_balance (size_t *nFarms, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers, size_t nSample, size_t nReplicas) {
+	assert (nFarms != NULL);
+	assert (src != NULL);
+	assert (workerList != NULL);
+
+	if (nSample > nJob)
+		nSample = nJob;
+	if (nReplicas < nWorkers)
+		nReplicas = nWorkers;
+
+	// Run the sample through the stages on a copy, timing each stage
+	void *sample = scratch_alloc(nSample * sizeJob);
+	memcpy(sample, src, nSample * sizeJob);
+
+	long long *cost = scratch_alloc(nWorkers * sizeof(long long));
+	long long totalCost = 0, maxCost = 1;
+	for (size_t j = 0; j < nWorkers; j++) {
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (size_t k = 0; k < nSample; k++)
+			workerList[j](sample + k*sizeJob, sample + k*sizeJob);
+		cost[j] = elapsedNanoseconds(&start) + 1;
+
+		totalCost += cost[j];
+		if (cost[j] > maxCost)
+			maxCost = cost[j];
+	}
+
+	// The most expensive stage gets its share of the replicas, the others are scaled to match its throughput
+	size_t maxReplicas = (size_t)((double)nReplicas * maxCost / totalCost + 0.5);
+	if (maxReplicas < 1)
+		maxReplicas = 1;
+	for (size_t j = 0; j < nWorkers; j++) {
+		nFarms[j] = (size_t)((double)maxReplicas * cost[j] / maxCost + 0.5);
+		if (nFarms[j] < 1)
+			nFarms[j] = 1;
+	}
+
+	scratch_free(cost);
+	scratch_free(sample);
+}
+
+void pipeline_farm_stages (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers, const size_t *nFarms) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (workerList != NULL);
+
+	if (nWorkers == 0 || nJob == 0) {
+		memcpy(dest, src, nJob*sizeJob);
+		return;
+	}
+
+	size_t *replicas = scratch_alloc(nWorkers * sizeof(size_t));
+	if (nFarms != NULL)
+		memcpy(replicas, nFarms, nWorkers * sizeof(size_t));
+	else
+		pipeline_farm_balance(replicas, src, nJob, sizeJob, workerList, nWorkers, PIPELINE_SAMPLE, par_nworkers());
+
+	// A batch holds one item per replica of the widest stage
+	size_t batchSize = 1;
+	for (size_t j = 0; j < nWorkers; j++) {
+		assert (replicas[j] > 0);
+		if (replicas[j] > batchSize)
+			batchSize = replicas[j];
+	}
+	size_t nBatches = (nJob / batchSize) + (nJob % batchSize == 0 ? 0 : 1);
+
+	// At step i, stage j works on batch i-j
+	Farm_Step_Args args = { dest, src, nJob, sizeJob, workerList, replicas, batchSize, nBatches };
+	size_t limit = nBatches + nWorkers-1;
+	for (size_t i = 0; i < limit; i++) {
+		size_t firstStage = i < nBatches ? 0 : i - nBatches + 1;
+		size_t lastStage = i < nWorkers ? i : nWorkers-1;
+
+		args.step = i;
+		par_for(firstStage, lastStage+1, 1, farmStepRange, &args);
+	}
+
+	scratch_free(replicas);
+}
+
+/*
+ * State shared by the stage runners of pipeline_async and pipeline_stream.
+ * Stage j may process item i once stage j-1 has finished it (ready[j-1] > i) and stage j has
+ * finished item i-1 (ready[j] == i). A stage is only run by whoever claims it while it is idle
+ * (active[j] == 0), so every stage handles its items in order and one at a time, without any
+ * global barrier.
+ * Item i lives in slot i % window of the buffer, the first stage only reuses a slot after the
+ * last stage is done with it.
+ */
+typedef struct Pipeline_State {
+	void *buffer;         // Slots holding the items in flight
+	size_t window;        // # slots in the buffer
+	size_t sizeJob;       // Size of each item
+	size_t nJob;          // # items, SIZE_MAX until the producer is exhausted
+	size_t nStages;       // # stages, including the producer and consumer of a stream
+	void (**workerList)(void *v1, const void *v2);
+	void *src;            // pipeline_async: array copied into the buffer by the first stage
+	int (*producer)(void *item, void *arg);         // pipeline_stream: first stage
+	void (*consumer)(const void *item, void *arg);  // pipeline_stream: last stage
+	void *arg;            // Argument of the producer and consumer
+	size_t *ready;        // # items finished by each stage
+	int *active;          // 1 while a runner is executing the stage
+	struct Stage_Runner *runners;  // Argument of the runner of each stage
+} Pipeline_State;
+
+typedef struct Stage_Runner {
+	Pipeline_State *state;
+	size_t stage;
+} Stage_Runner;
+
+static int stageHasInput(Pipeline_State *state, size_t stage, size_t item) {
+	if (item >= __atomic_load_n(&state->nJob, __ATOMIC_SEQ_CST))
+		return 0;
+
+	if (stage > 0)
+		return __atomic_load_n(&state->ready[stage-1], __ATOMIC_SEQ_CST) > item;
+
+	// The slot of the item must have been released by the last stage
+	return item < state->window || __atomic_load_n(&state->ready[state->nStages-1], __ATOMIC_SEQ_CST) > item - state->window;
+}
+
+// Returns 1 if the caller became the (only) runner of the stage
+static int claimStage(Pipeline_State *state, size_t stage) {
+	int idle = 0;
+	return __atomic_compare_exchange_n(&state->active[stage], &idle, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Returns 0 if the item does not exist because the producer is exhausted
+static int runStage(Pipeline_State *state, size_t stage, size_t item) {
+	void* job = state->buffer + (item % state->window)*state->sizeJob;
+
+	if (state->producer != NULL) {
+		if (stage == 0)
+			return state->producer(job, state->arg);
+		if (stage == state->nStages-1)
+			state->consumer(job, state->arg);
+		else
+			state->workerList[stage-1](job, job);
+		return 1;
+	}
+
+	if (stage == 0)
+		memcpy(job, state->src + item*state->sizeJob, state->sizeJob);
+	state->workerList[stage](job, job);
+	return 1;
+}
+
+static void stageHelper(void *arg);
+
+// Claims an idle stage that has input, returns nStages if there is none
+static size_t claimIdleStage(Pipeline_State *state) {
+	for (size_t stage = 0; stage < state->nStages; stage++)
+		if (__atomic_load_n(&state->active[stage], __ATOMIC_SEQ_CST) == 0
+				&& stageHasInput(state, stage, __atomic_load_n(&state->ready[stage], __ATOMIC_SEQ_CST))
+				&& claimStage(state, stage))
+			return stage;
+	return state->nStages;
+}
+
+/*
+ * Runs a claimed stage until it runs out of input, releases it, and goes on with any other idle
+ * stage that has input, until there is none. Only the runner started by runPipelineState starts
+ * helpers for the stages that become ready meanwhile; helpers never start anyone, so runners do
+ * not nest however many items go through a small window.
+ */
+static void runStages(Pipeline_State *state, size_t stage, int startHelpers) {
+	PAR_FRAME;
+
+	while (stage < state->nStages) {
+		size_t item = state->ready[stage];
+
+		for (;;) {
+			if (!stageHasInput(state, stage, item)) {
+				__atomic_store_n(&state->active[stage], 0, __ATOMIC_SEQ_CST);
+
+				// The previous stage may have finished an item after the check above
+				if (!stageHasInput(state, stage, item) || !claimStage(state, stage))
+					break;
+				continue;
 			}
+
+			if (!runStage(state, stage, item)) {
+				__atomic_store_n(&state->nJob, item, __ATOMIC_SEQ_CST);
+				continue;
+			}
+
+			item++;
+			__atomic_store_n(&state->ready[stage], item, __ATOMIC_SEQ_CST);
+
+			// Start the stages that were waiting for this item or for its slot
+			if (startHelpers)
+				for (size_t idle = claimIdleStage(state); idle < state->nStages; idle = claimIdleStage(state))
+					PAR_SPAWN(stageHelper, &state->runners[idle]);
 		}
+
+		stage = claimIdleStage(state);
+	}
+
+	PAR_SYNC;
+}
+
+static void stageHelper(void *arg) {
+	runStages(((Stage_Runner *)arg)->state, ((Stage_Runner *)arg)->stage, 0);
+}
+
+static void stageRunner(void *arg) {
+	runStages(((Stage_Runner *)arg)->state, ((Stage_Runner *)arg)->stage, 1);
+}
+
+static void runPipelineState(Pipeline_State *state) {
+	state->ready = scratch_alloc(state->nStages * sizeof(size_t));
+	state->active = scratch_alloc(state->nStages * sizeof(int));
+	memset(state->ready, 0, state->nStages * sizeof(size_t));
+	memset(state->active, 0, state->nStages * sizeof(int));
+	state->runners = scratch_alloc(state->nStages * sizeof(Stage_Runner));
+	for (size_t j = 0; j < state->nStages; j++)
+		state->runners[j] = (Stage_Runner) { state, j };
+
+	// The first stage never waits for the others to start
+	state->active[0] = 1;
+	par_run(stageRunner, &state->runners[0]);
+
+	scratch_free(state->runners);
+	scratch_free(state->active);
+	scratch_free(state->ready);
+}
+
+void pipeline_async (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (workerList != NULL);
+
+	if (nWorkers == 0 || nJob == 0) {
+		memcpy(dest, src, nJob*sizeJob);
+		return;
+	}
+
+	Pipeline_State state = {
+		.buffer = dest,
+		.window = nJob,
+		.sizeJob = sizeJob,
+		.nJob = nJob,
+		.nStages = nWorkers,
+		.workerList = workerList,
+		.src = src
+	};
+
+	runPipelineState(&state);
+}
+
+void pipeline_stream (int (*producer)(void *item, void *arg), void (*consumer)(const void *item, void *arg), void *arg, size_t sizeJob,
+		void (*workerList[])(void *v1, const void *v2), size_t nWorkers, size_t window)
+{
+	assert (producer != NULL);
+	assert (consumer != NULL);
+	assert (workerList != NULL || nWorkers == 0);
+	assert (window > 0);
+
+	Pipeline_State state = {
+		.buffer = scratch_alloc(window * sizeJob),
+		.window = window,
+		.sizeJob = sizeJob,
+		.nJob = SIZE_MAX,
+		.nStages = nWorkers + 2,
+		.workerList = workerList,
+		.producer = producer,
+		.consumer = consumer,
+		.arg = arg
+	};
+
+	runPipelineState(&state);
+
+	scratch_free(state.buffer);
+}
+
+void pipeline_stream_seq (int (*producer)(void *item, void *arg), void (*consumer)(const void *item, void *arg), void *arg, size_t sizeJob,
+		void (*workerList[])(void *v1, const void *v2), size_t nWorkers, size_t window)
+{
+	assert (producer != NULL);
+	assert (consumer != NULL);
+	assert (workerList != NULL || nWorkers == 0);
+
+	void *job = scratch_alloc(sizeJob);
+
+	while (producer(job, arg)) {
+		for (size_t j = 0;  j < nWorkers;  j++)
+			workerList[j](job, job);
+		consumer(job, arg);
 	}
+
+	scratch_free(job);
 }
 
 void pipeline_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
@@ -417,12 +1011,25 @@ void pipeline_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*wo
 	}
 }
 
-void farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t nWorkers) {
-	assert (dest != NULL);
-	assert (src != NULL);
-	assert (worker != NULL);
-
-	cilk_for(size_t i = 0; i < nWorkers; i++){
+/*
+ * Workers [start, end) of farm and farm_dynamic.
+ */
+typedef struct Farm_Args {
+	void *dest;
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2);
+	size_t nWorkers;
+	size_t minChunk;      // farm_dynamic only
+	size_t next;          // farm_dynamic only: first job not taken yet
+} Farm_Args;
+
+static void farmRange(size_t first, size_t last, void *arg) {
+	Farm_Args *args = arg;
+	size_t nJob = args->nJob, nWorkers = args->nWorkers, sizeJob = args->sizeJob;
+
+	for (size_t i = first; i < last; i++) {
 		// Compute the amount of work each worker gets, distributing the remaining across multiple workers
 		size_t batchSize = (nJob / nWorkers) + (( i < nJob % nWorkers) ? 1 : 0);
 
@@ -430,12 +1037,402 @@ void farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(vo
 		size_t start = i*(nJob / nWorkers) + (( i < nJob % nWorkers) ? i : nJob % nWorkers);
 
 		// In each worker, execute sequentially each job on his batch
-		for(int j = 0; j < batchSize; j++ ) {
-			worker(dest + (start+j) * sizeJob, src + (start+j) * sizeJob);
+		for(size_t j = 0; j < batchSize; j++ ) {
+			args->worker(args->dest + (start+j) * sizeJob, args->src + (start+j) * sizeJob);
 		}
 	}
 }
 
+void farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t nWorkers) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (worker != NULL);
+
+	Farm_Args args = { dest, src, nJob, sizeJob, worker, nWorkers };
+	par_for(0, nWorkers, 1, farmRange, &args);
+}
+
+/*
+ * Takes the next chunk of jobs from the shared counter. Chunks start large and shrink as the
+ * remaining work decreases (guided scheduling), down to minChunk jobs.
+ * Returns 0 when there are no jobs left.
+ */
+static int nextChunk(size_t *next, size_t nJob, size_t nWorkers, size_t minChunk, size_t *start, size_t *end) {
+	size_t first = __atomic_load_n(next, __ATOMIC_RELAXED);
+	size_t chunk;
+
+	do {
+		if (first >= nJob)
+			return 0;
+
+		chunk = (nJob - first) / (2 * nWorkers);
+		if (chunk < minChunk)
+			chunk = minChunk;
+		if (chunk > nJob - first)
+			chunk = nJob - first;
+	} while (!__atomic_compare_exchange_n(next, &first, first + chunk, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	*start = first;
+	*end = first + chunk;
+	return 1;
+}
+
+static void farmDynamicRange(size_t first, size_t last, void *arg) {
+	Farm_Args *args = arg;
+	size_t start, end;
+
+	for (size_t i = first; i < last; i++) {
+		while (nextChunk(&args->next, args->nJob, args->nWorkers, args->minChunk, &start, &end)) {
+			for (size_t j = start; j < end; j++)
+				args->worker(args->dest + j * args->sizeJob, args->src + j * args->sizeJob);
+		}
+	}
+}
+
+void farm_dynamic (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t nWorkers, size_t minChunk) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (worker != NULL);
+	assert (nWorkers > 0);
+
+	if (minChunk == 0)
+		minChunk = 1;
+
+	// Instead of a fixed batch, each worker keeps taking chunks until the jobs run out
+	Farm_Args args = { dest, src, nJob, sizeJob, worker, nWorkers, minChunk, 0 };
+	par_for(0, nWorkers, 1, farmDynamicRange, &args);
+}
+
 void farm_seq (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t nWorkers) {
 	map (dest, src, nJob, sizeJob, worker);
 }
+
+/*
+ * Per-worker states of a _ctx pattern call. Each slot starts with its initialized flag and is
+ * padded to a cache line, so that workers do not share lines.
+ */
+typedef struct Worker_States {
+	const Worker_Context *context;
+	size_t nSlots;
+	size_t slotSize;
+	char *slots;
+} Worker_States;
+
+#define CACHE_LINE 64
+#define STATE_OFFSET CACHE_LINE
+
+static void createWorkerStates(Worker_States *states, const Worker_Context *context) {
+	assert (context != NULL);
+
+	states->context = context;
+	states->nSlots = par_total_workers();
+	states->slotSize = STATE_OFFSET + ((context->stateSize + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE;
+	states->slots = scratch_alloc(states->nSlots * states->slotSize);
+	assert (states->slots != NULL);
+
+	for (size_t i = 0; i < states->nSlots; i++)
+		*(int *)(states->slots + i * states->slotSize) = 0;
+}
+
+// State of the calling worker, initialized on first use
+static void *workerState(Worker_States *states) {
+	int id = par_worker_id();
+	assert (id >= 0 && id < states->nSlots);
+
+	char *slot = states->slots + id * states->slotSize;
+	void *state = slot + STATE_OFFSET;
+
+	if (!*(int *)slot) {
+		if (states->context->init != NULL)
+			states->context->init(state, states->context->ctx);
+		*(int *)slot = 1;
+	}
+
+	return state;
+}
+
+static void destroyWorkerStates(Worker_States *states) {
+	for (size_t i = 0; i < states->nSlots; i++) {
+		char *slot = states->slots + i * states->slotSize;
+		if (*(int *)slot && states->context->fini != NULL)
+			states->context->fini(slot + STATE_OFFSET, states->context->ctx);
+	}
+
+	scratch_free(states->slots);
+}
+
+typedef struct Ctx_Args {
+	void *dest;
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2, void *ctx, void *state);
+	size_t nWorkers;
+	Worker_States *states;
+} Ctx_Args;
+
+static void mapCtxRange(size_t start, size_t end, void *arg) {
+	Ctx_Args *args = arg;
+	void *ctx = args->states->context->ctx;
+	for (size_t i = start; i < end; i++)
+		args->worker(args->dest + i * args->sizeJob, args->src + i * args->sizeJob, ctx, workerState(args->states));
+}
+
+static void farmCtxRange(size_t first, size_t last, void *arg) {
+	Ctx_Args *args = arg;
+	size_t nJob = args->nJob, nWorkers = args->nWorkers, sizeJob = args->sizeJob;
+	void *ctx = args->states->context->ctx;
+
+	for (size_t i = first; i < last; i++) {
+		// Same batches as farm
+		size_t batchSize = (nJob / nWorkers) + (( i < nJob % nWorkers) ? 1 : 0);
+		size_t start = i*(nJob / nWorkers) + (( i < nJob % nWorkers) ? i : nJob % nWorkers);
+
+		void *state = workerState(args->states);
+		for(size_t j = 0; j < batchSize; j++ ) {
+			args->worker(args->dest + (start+j) * sizeJob, args->src + (start+j) * sizeJob, ctx, state);
+		}
+	}
+}
+
+void map_ctx (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, void *ctx, void *state), const Worker_Context *context) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (worker != NULL);
+
+	Worker_States states;
+	createWorkerStates(&states, context);
+
+	Ctx_Args args = { dest, src, nJob, sizeJob, worker, 0, &states };
+	par_for(0, nJob, 0, mapCtxRange, &args);
+
+	destroyWorkerStates(&states);
+}
+
+void farm_ctx (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, void *ctx, void *state), size_t nWorkers, const Worker_Context *context) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (worker != NULL);
+
+	Worker_States states;
+	createWorkerStates(&states, context);
+
+	Ctx_Args args = { dest, src, nJob, sizeJob, worker, nWorkers, &states };
+	par_for(0, nWorkers, 1, farmCtxRange, &args);
+
+	destroyWorkerStates(&states);
+}
+
+/*
+ * Stages [start, end) of step i of pipeline_ctx, each run with the state of the worker that executes it.
+ */
+typedef struct Ctx_Step_Args {
+	void *dest;
+	size_t sizeJob;
+	void (**workerList)(void *v1, const void *v2, void *ctx, void *state);
+	Worker_States *states;
+	size_t step;
+} Ctx_Step_Args;
+
+static void ctxStepRange(size_t start, size_t end, void *arg) {
+	Ctx_Step_Args *args = arg;
+	for (size_t j = start; j < end; j++) {
+		void *job = args->dest + (args->step-j)*args->sizeJob;
+		args->workerList[j](job, job, args->states[j].context->ctx, workerState(&args->states[j]));
+	}
+}
+
+void pipeline_ctx (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2, void *ctx, void *state), size_t nWorkers, const Worker_Context *contextList) {
+	assert (dest != NULL);
+	assert (src != NULL);
+	assert (workerList != NULL);
+	assert (contextList != NULL);
+
+	if (nWorkers == 0) {
+		memcpy(dest, src, nJob*sizeJob);
+		return;
+	}
+
+	Worker_States *states = scratch_alloc(nWorkers * sizeof(Worker_States));
+	for (size_t j = 0; j < nWorkers; j++)
+		createWorkerStates(&states[j], &contextList[j]);
+
+	Copy_Args copy = { dest, src, sizeJob };
+	par_for(0, nJob, 0, copyRange, &copy);
+
+	// At step i, stage j works on item i-j, as in pipeline
+	Ctx_Step_Args args = { dest, sizeJob, workerList, states };
+	size_t limit = nJob + nWorkers-1;
+	for (size_t i = 0; i < limit; i++) {
+		size_t firstStage = i < nJob ? 0 : i - nJob + 1;
+		size_t lastStage = i < nWorkers ? i : nWorkers-1;
+
+		args.step = i;
+		par_for(firstStage, lastStage+1, 1, ctxStepRange, &args);
+	}
+
+	for (size_t j = 0; j < nWorkers; j++)
+		destroyWorkerStates(&states[j]);
+	scratch_free(states);
+}
+
+// # elements of the blocks of the large problems of a batch, problems up to this size are not split
+#define PROBLEM_BLOCK 4096
+
+/*
+ * A batch is run over the blocks of all its problems: first a sequential pass over each block
+ * (the scan of the first block of each problem, the reduction of the others), then the carry
+ * of each block from the reductions of the blocks before it in its problem, and for scans the
+ * blocks after the first are scanned again from their carry.
+ */
+typedef struct Problems_Args {
+	Pattern_Problem *problems;
+	size_t nProblems;
+	size_t sizeJob;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+	int isScan;
+	size_t *firstBlock;   // First block of each problem, and the # blocks in firstBlock[nProblems]
+	void *partial;        // Reduction of each block
+	void *carry;          // Reduction of the blocks before each block in its problem
+} Problems_Args;
+
+// Problem of a block: the last problem whose first block is not after it
+static size_t problemOf(Problems_Args *args, size_t block) {
+	size_t low = 0, high = args->nProblems;
+	while (high - low > 1) {
+		size_t mid = (low + high) / 2;
+		if (args->firstBlock[mid] <= block)
+			low = mid;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+// Source and target of a block, returns its # elements
+static size_t blockOf(Problems_Args *args, size_t problem, size_t block, void **src, void **dest) {
+	Pattern_Problem *p = &args->problems[problem];
+	size_t first = (block - args->firstBlock[problem]) * PROBLEM_BLOCK;
+	size_t n = p->nJob - first < PROBLEM_BLOCK ? p->nJob - first : PROBLEM_BLOCK;
+
+	*src = p->src + first * args->sizeJob;
+	*dest = p->dest + first * args->sizeJob;
+	return n;
+}
+
+// dest[i] = op (dest[i-1], src[i]), from dest[-1] = carry
+static void scanBlock(void *dest, void *src, size_t n, size_t sizeJob, const void *carry, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	if (carry == NULL)
+		memcpy(dest, src, sizeJob);
+	else
+		worker(dest, carry, src);
+	for (size_t i = 1; i < n; i++)
+		worker(dest + i * sizeJob, dest + (i-1) * sizeJob, src + i * sizeJob);
+}
+
+static void problemBlocksRange(size_t start, size_t end, void *arg) {
+	Problems_Args *args = arg;
+	size_t sizeJob = args->sizeJob;
+	size_t problem = problemOf(args, start);
+
+	for (size_t block = start; block < end; block++) {
+		while (args->firstBlock[problem + 1] <= block)
+			problem++;
+
+		void *src, *dest;
+		size_t n = blockOf(args, problem, block, &src, &dest);
+		void *partial = args->partial + block * sizeJob;
+
+		if (args->isScan && block == args->firstBlock[problem]) {
+			scanBlock(dest, src, n, sizeJob, NULL, args->worker);
+			memcpy(partial, dest + (n-1) * sizeJob, sizeJob);
+		} else {
+			// The carry slot of the block is free until the next pass, use it as the second accumulator
+			void *tmp = args->carry + block * sizeJob;
+			memcpy(partial, src, sizeJob);
+			for (size_t i = 1; i < n; i++) {
+				args->worker(tmp, partial, src + i * sizeJob);
+				memcpy(partial, tmp, sizeJob);
+			}
+		}
+	}
+}
+
+static void problemCarryRange(size_t start, size_t end, void *arg) {
+	Problems_Args *args = arg;
+	size_t sizeJob = args->sizeJob;
+
+	for (size_t problem = start; problem < end; problem++) {
+		size_t first = args->firstBlock[problem], last = args->firstBlock[problem + 1];
+		if (first == last)
+			continue;
+
+		if (last - first > 1) {
+			memcpy(args->carry + (first + 1) * sizeJob, args->partial + first * sizeJob, sizeJob);
+			for (size_t block = first + 2; block < last; block++)
+				args->worker(args->carry + block * sizeJob, args->carry + (block-1) * sizeJob, args->partial + (block-1) * sizeJob);
+		}
+
+		if (!args->isScan) {
+			void *dest = args->problems[problem].dest;
+			if (last - first == 1)
+				memcpy(dest, args->partial + first * sizeJob, sizeJob);
+			else
+				args->worker(dest, args->carry + (last-1) * sizeJob, args->partial + (last-1) * sizeJob);
+		}
+	}
+}
+
+static void problemRescanRange(size_t start, size_t end, void *arg) {
+	Problems_Args *args = arg;
+	size_t problem = problemOf(args, start);
+
+	for (size_t block = start; block < end; block++) {
+		while (args->firstBlock[problem + 1] <= block)
+			problem++;
+		if (block == args->firstBlock[problem])
+			continue;
+
+		void *src, *dest;
+		size_t n = blockOf(args, problem, block, &src, &dest);
+		scanBlock(dest, src, n, args->sizeJob, args->carry + block * args->sizeJob, args->worker);
+	}
+}
+
+static void runProblems(Pattern_Problem *problems, size_t nProblems, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3), int isScan) {
+	assert (problems != NULL || nProblems == 0);
+	assert (worker != NULL);
+
+	// One allocation for the block index and the partials of the whole batch
+	size_t nBlocks = 0;
+	for (size_t p = 0; p < nProblems; p++)
+		nBlocks += (problems[p].nJob + PROBLEM_BLOCK - 1) / PROBLEM_BLOCK;
+
+	size_t indexSize = (nProblems + 1) * sizeof(size_t);
+	void *memory = scratch_alloc(indexSize + 2 * nBlocks * sizeJob);
+
+	Problems_Args args = { problems, nProblems, sizeJob, worker, isScan, memory, memory + indexSize, memory + indexSize + nBlocks * sizeJob };
+
+	nBlocks = 0;
+	for (size_t p = 0; p < nProblems; p++) {
+		assert (problems[p].nJob == 0 || (problems[p].dest != NULL && problems[p].src != NULL));
+		args.firstBlock[p] = nBlocks;
+		nBlocks += (problems[p].nJob + PROBLEM_BLOCK - 1) / PROBLEM_BLOCK;
+	}
+	args.firstBlock[nProblems] = nBlocks;
+
+	par_for(0, nBlocks, 0, problemBlocksRange, &args);
+	par_for(0, nProblems, 0, problemCarryRange, &args);
+	if (isScan)
+		par_for(0, nBlocks, 0, problemRescanRange, &args);
+
+	scratch_free(memory);
+}
+
+void reduce_batch (Pattern_Problem *problems, size_t nProblems, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	runProblems(problems, nProblems, sizeJob, worker, 0);
+}
+
+void scan_batch (Pattern_Problem *problems, size_t nProblems, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	runProblems(problems, nProblems, sizeJob, worker, 1);
+}
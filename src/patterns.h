@@ -143,6 +143,95 @@ void pipeline_farm (
   size_t nFarms		      // # simultaneous pipelines
 );
 
+/*
+ * Pipeline whose stages change the element type: stage j reads elements of sizeJob[j] bytes and
+ * writes elements of sizeJob[j+1] bytes. The intermediate elements are kept in a double buffer
+ * per stage, so neither src nor dest has to be sized for the largest intermediate.
+ */
+void pipeline_typed (
+  void *dest,           // Target array, of elements of sizeJob[nWorkers] bytes
+  void *src,            // Source array, of elements of sizeJob[0] bytes
+  size_t nJob,          // # elements in the source array
+  const size_t *sizeJob,// Size of the elements before and after each stage (nWorkers+1 entries)
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers       // # stages in the pipeline
+);
+
+void pipeline_typed_seq (
+  void *dest,           // Target array, of elements of sizeJob[nWorkers] bytes
+  void *src,            // Source array, of elements of sizeJob[0] bytes
+  size_t nJob,          // # elements in the source array
+  const size_t *sizeJob,// Size of the elements before and after each stage (nWorkers+1 entries)
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers       // # stages in the pipeline
+);
+
+/*
+ * Pipeline farm with a different number of replicas for each stage, so that only the bottleneck
+ * stages are farmed. With nFarms == NULL the replicas are chosen by pipeline_farm_balance.
+ */
+void pipeline_farm_stages (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers,      // # stages in the pipeline
+  const size_t *nFarms  // # replicas of each stage, or NULL
+);
+
+/*
+ * Times each stage over the first nSample items and spreads nReplicas among the stages
+ * in proportion to their cost, so that all stages have about the same throughput.
+ */
+void pipeline_farm_balance (
+  size_t *nFarms,       // Output: # replicas of each stage
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers,      // # stages in the pipeline
+  size_t nSample,       // # elements to time
+  size_t nReplicas      // # replicas to spread among the stages
+);
+
+/*
+ * Pipeline without global barriers: each stage processes an item as soon as the previous
+ * stage has finished it, so a slow stage only delays the items that go through it.
+ */
+void pipeline_async (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers       // # stages in the pipeline
+);
+
+/*
+ * Pipeline over a stream: items are pulled from the producer, go through the stages and are
+ * pushed to the consumer in order. At most window items are in flight (and in memory) at once.
+ */
+void pipeline_stream (
+  int (*producer)(void *item, void *arg),         // writes the next item, returns 0 at the end of the stream
+  void (*consumer)(const void *item, void *arg),  // receives each result, in order
+  void *arg,            // passed to the producer and the consumer
+  size_t sizeJob,       // Size of each element in the stream
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers,      // # stages in the pipeline
+  size_t window         // # items in flight
+);
+
+void pipeline_stream_seq (
+  int (*producer)(void *item, void *arg),         // writes the next item, returns 0 at the end of the stream
+  void (*consumer)(const void *item, void *arg),  // receives each result, in order
+  void *arg,            // passed to the producer and the consumer
+  size_t sizeJob,       // Size of each element in the stream
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers,      // # stages in the pipeline
+  size_t window         // # items in flight
+);
+
 void pipeline_seq (
   void *dest,           // Target array
   void *src,            // Source array
@@ -161,6 +250,21 @@ void farm (
   size_t nWorkers       // # workers in the farm
 );
 
+/*
+ * Farm with dynamic load balancing: the workers take chunks of jobs from a shared counter,
+ * with chunk sizes decreasing as the work runs out, so expensive regions of the input do
+ * not all end up in the same worker.
+ */
+void farm_dynamic (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2),  // [ v1 = op (22) ]
+  size_t nWorkers,      // # workers in the farm
+  size_t minChunk       // # jobs of the smallest chunk
+);
+
 void farm_seq (
   void *dest,           // Target array
   void *src,            // Source array
@@ -170,4 +274,75 @@ void farm_seq (
   size_t nWorkers       // # workers in the farm
 );
 
+/*
+ * Context of the _ctx patterns. The user context is shared by all the workers, while each
+ * worker gets its own state slot of stateSize bytes (scratch memory, lookup tables, RNGs, ...).
+ * A slot is set up by init the first time its worker runs a job of the call, and torn down by
+ * fini at the end of the call.
+ */
+typedef struct Worker_Context {
+  void *ctx;            // User context, shared by all the workers
+  size_t stateSize;     // Size of the state of each worker
+  void (*init)(void *state, void *ctx);   // Sets up the state of a worker, may be NULL
+  void (*fini)(void *state, void *ctx);   // Tears down the state of a worker, may be NULL
+} Worker_Context;
+
+void map_ctx (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, void *ctx, void *state), // [ v1 = op (v2) ]
+  const Worker_Context *context
+);
+
+void farm_ctx (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, void *ctx, void *state), // [ v1 = op (v2) ]
+  size_t nWorkers,      // # workers in the farm
+  const Worker_Context *context
+);
+
+void pipeline_ctx (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2, void *ctx, void *state), // one function for each stage of the pipeline
+  size_t nWorkers,      // # stages in the pipeline
+  const Worker_Context *contextList  // one context for each stage of the pipeline
+);
+
+/*
+ * One problem of a batch: dest = pattern (src), over nJob elements.
+ */
+typedef struct Pattern_Problem {
+  void *dest;           // Target array (a single element for reduce)
+  void *src;            // Source array
+  size_t nJob;          // # elements in the source array
+} Pattern_Problem;
+
+/*
+ * Batches of independent reductions and scans, for many small problems. The batch is
+ * parallelized across problems: small problems run sequentially on one worker, large ones are
+ * split into blocks, and the temporaries of the whole batch come from a single allocation.
+ * Problems with no elements are skipped.
+ */
+void reduce_batch (
+  Pattern_Problem *problems,  // Problems of the batch
+  size_t nProblems,     // # problems in the batch
+  size_t sizeJob,       // Size of each element in the source arrays
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+void scan_batch (
+  Pattern_Problem *problems,  // Problems of the batch
+  size_t nProblems,     // # problems in the batch
+  size_t sizeJob,       // Size of each element in the source arrays
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
 #endif
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "patterns.h"
+#include "patterns_async.h"
+
+/*
+ * Implementation of the non-blocking patterns.
+ * Each call fills a handle with the arguments of the pattern and queues it. A small pool of
+ * launcher threads, started on the first call, takes the handles in order and runs the blocking
+ * pattern; a handle waits in the queue only while every launcher is busy.
+ */
+
+// # patterns that can be running at the same time
+#define ASYNC_LAUNCHERS 4
+
+typedef enum Async_Pattern {
+	ASYNC_MAP,
+	ASYNC_REDUCE,
+	ASYNC_SCAN,
+	ASYNC_PACK,
+	ASYNC_SPLIT,
+	ASYNC_GATHER,
+	ASYNC_SCATTER,
+	ASYNC_PIPELINE,
+	ASYNC_FARM
+} Async_Pattern;
+
+struct Async_Handle {
+	Async_Pattern pattern;
+	void *dest;
+	void *src;
+	size_t nJob;
+	size_t sizeJob;
+	void (*mapWorker)(void *v1, const void *v2);
+	void (*reduceWorker)(void *v1, const void *v2, const void *v3);
+	void (**workerList)(void *v1, const void *v2);
+	size_t nWorkers;
+	const int *filter;
+	int nFilter;
+
+	int result;           // # elements written by pack and split
+	int done;
+	Async_Handle *next;   // Next handle in the queue
+};
+
+static pthread_once_t launchers_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_submitted = PTHREAD_COND_INITIALIZER;  // Signalled when a handle is queued
+static pthread_cond_t async_completed = PTHREAD_COND_INITIALIZER;  // Broadcast when a handle is done
+
+static Async_Handle *queue_head = NULL;
+static Async_Handle *queue_tail = NULL;
+
+static void runPattern(Async_Handle *handle) {
+	switch (handle->pattern) {
+	case ASYNC_MAP:
+		map(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->mapWorker);
+		break;
+	case ASYNC_REDUCE:
+		reduce(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->reduceWorker);
+		break;
+	case ASYNC_SCAN:
+		scan(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->reduceWorker);
+		break;
+	case ASYNC_PACK:
+		handle->result = pack(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->filter);
+		break;
+	case ASYNC_SPLIT:
+		handle->result = split(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->filter);
+		break;
+	case ASYNC_GATHER:
+		gather(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->filter, handle->nFilter);
+		break;
+	case ASYNC_SCATTER:
+		scatter(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->filter);
+		break;
+	case ASYNC_PIPELINE:
+		pipeline(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->workerList, handle->nWorkers);
+		break;
+	case ASYNC_FARM:
+		farm(handle->dest, handle->src, handle->nJob, handle->sizeJob, handle->mapWorker, handle->nWorkers);
+		break;
+	}
+}
+
+static void *launch(void *arg) {
+	pthread_mutex_lock(&async_lock);
+	for (;;) {
+		while (queue_head == NULL)
+			pthread_cond_wait(&async_submitted, &async_lock);
+
+		Async_Handle *handle = queue_head;
+		queue_head = handle->next;
+		if (queue_head == NULL)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&async_lock);
+
+		runPattern(handle);
+
+		pthread_mutex_lock(&async_lock);
+		__atomic_store_n(&handle->done, 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&async_completed);
+	}
+
+	return NULL;
+}
+
+// The launchers live as long as the process, idle ones only wait on the queue
+static void startLaunchers(void) {
+	for (int i = 0; i < ASYNC_LAUNCHERS; i++) {
+		pthread_t launcher;
+		int error = pthread_create(&launcher, NULL, launch, NULL);
+		assert (error == 0);
+		pthread_detach(launcher);
+		(void) error;
+	}
+}
+
+static Async_Handle *submit(Async_Handle handle) {
+	assert (handle.dest != NULL);
+	assert (handle.src != NULL);
+
+	Async_Handle *queued = malloc(sizeof(Async_Handle));
+	assert (queued != NULL);
+	*queued = handle;
+
+	pthread_once(&launchers_once, startLaunchers);
+
+	pthread_mutex_lock(&async_lock);
+	if (queue_tail == NULL)
+		queue_head = queued;
+	else
+		queue_tail->next = queued;
+	queue_tail = queued;
+	pthread_cond_signal(&async_submitted);
+	pthread_mutex_unlock(&async_lock);
+
+	return queued;
+}
+
+int async_test (Async_Handle *handle) {
+	assert (handle != NULL);
+
+	return __atomic_load_n(&handle->done, __ATOMIC_ACQUIRE);
+}
+
+int async_wait (Async_Handle *handle) {
+	assert (handle != NULL);
+
+	pthread_mutex_lock(&async_lock);
+	while (!__atomic_load_n(&handle->done, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&async_completed, &async_lock);
+	pthread_mutex_unlock(&async_lock);
+
+	int result = handle->result;
+	free(handle);
+
+	return result;
+}
+
+Async_Handle *async_map (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2)) {
+	assert (worker != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_MAP, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .mapWorker = worker });
+}
+
+Async_Handle *async_reduce (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (worker != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_REDUCE, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .reduceWorker = worker });
+}
+
+Async_Handle *async_scan (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	assert (worker != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_SCAN, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .reduceWorker = worker });
+}
+
+Async_Handle *async_pack (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter) {
+	assert (filter != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_PACK, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .filter = filter });
+}
+
+Async_Handle *async_split (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter) {
+	assert (filter != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_SPLIT, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .filter = filter });
+}
+
+Async_Handle *async_gather (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter, int nFilter) {
+	assert (filter != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_GATHER, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .filter = filter, .nFilter = nFilter });
+}
+
+Async_Handle *async_scatter (void *dest, void *src, size_t nJob, size_t sizeJob, const int *filter) {
+	assert (filter != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_SCATTER, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .filter = filter });
+}
+
+Async_Handle *async_pipeline (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	assert (workerList != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_PIPELINE, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .workerList = workerList, .nWorkers = nWorkers });
+}
+
+Async_Handle *async_farm (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2), size_t nWorkers) {
+	assert (worker != NULL);
+
+	return submit((Async_Handle) { .pattern = ASYNC_FARM, .dest = dest, .src = src, .nJob = nJob, .sizeJob = sizeJob, .mapWorker = worker, .nWorkers = nWorkers });
+}
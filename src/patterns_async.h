@@ -0,0 +1,110 @@
+#ifndef __PATTERNS_ASYNC_H
+#define __PATTERNS_ASYNC_H
+
+#include <stddef.h>
+
+/*
+ * Non-blocking versions of the patterns: each call starts the pattern and returns a handle right
+ * away, so that several patterns can be in flight at once:
+ *
+ *   Async_Handle *first = async_scan (dest1, src1, n1, sizeof(double), workerAdd);
+ *   Async_Handle *second = async_gather (dest2, src2, n2, sizeof(double), filter, nFilter);
+ *   async_wait (first);
+ *   async_wait (second);
+ *
+ * The patterns are run by a few launcher threads that enter the threading backend like any other
+ * caller, so the patterns in flight share its workers. With the Cilk and pthreads backends they
+ * steal from each other; with OpenMP each one opens its own team.
+ *
+ * The arrays passed to a call must stay valid, and must not be written, until its handle is waited.
+ */
+
+typedef struct Async_Handle Async_Handle;
+
+/*
+ * Returns 1 if the pattern of the handle is done, 0 otherwise.
+ */
+int async_test (Async_Handle *handle);
+
+/*
+ * Waits until the pattern of the handle is done, and releases the handle. Returns the # elements
+ * written for pack and split, 0 for the other patterns.
+ */
+int async_wait (Async_Handle *handle);
+
+Async_Handle *async_map (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2) // [ v1 = op (v2) ]
+);
+
+Async_Handle *async_reduce (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+Async_Handle *async_scan (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+Async_Handle *async_pack (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  const int *filter     // Filter for pack
+);
+
+Async_Handle *async_split (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  const int *filter     // Filter for split
+);
+
+Async_Handle *async_gather (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  const int *filter,    // Filter for gather
+  int nFilter           // # elements in the filter
+);
+
+Async_Handle *async_scatter (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  const int *filter     // Filter for scatter
+);
+
+Async_Handle *async_pipeline (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers       // # stages in the pipeline
+);
+
+Async_Handle *async_farm (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2),  // [ v1 = op (v2) ]
+  size_t nWorkers       // # workers in the farm
+);
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef __PATTERNS_TYPED_H
+#define __PATTERNS_TYPED_H
+
+#include <stdlib.h>
+#include <assert.h>
+#include "parallel.h"
+#include "arena.h"
+
+/*
+ * Typed patterns, generated at compile time for an element type and an operator:
+ *
+ *   DEFINE_PATTERNS(double, add)
+ *
+ * defines map_double_add, reduce_double_add, scan_double_add, pack_double and gather_double.
+ * The operator is the macro PATTERNS_OP_<op>(a, b): add, mul, min and max are predefined, other
+ * operators are added by defining their macro before instantiating the patterns. As the operator
+ * is expanded inside the loops instead of being called through a worker pointer, the compiler
+ * can inline it and vectorize the loops. The generic patterns of patterns.h remain available for
+ * any element size and worker.
+ *
+ * The type must be a single identifier (a typedef for unsigned int, structs, ...), and several
+ * operators of the same type are instantiated with one DEFINE_TYPED_PATTERNS(T) and one
+ * DEFINE_OP_PATTERNS(T, op) per operator.
+ */
+
+#define PATTERNS_OP_add(a, b) ((a) + (b))
+#define PATTERNS_OP_mul(a, b) ((a) * (b))
+#define PATTERNS_OP_min(a, b) ((b) < (a) ? (b) : (a))
+#define PATTERNS_OP_max(a, b) ((b) > (a) ? (b) : (a))
+
+#define DEFINE_PATTERNS(T, OP) \
+	DEFINE_TYPED_PATTERNS(T) \
+	DEFINE_OP_PATTERNS(T, OP)
+
+/*
+ * Patterns that only depend on the operator through their loops:
+ *   map_T_OP    (T *dest, const T *src, size_t nJob, T value)  dest[i] = op (src[i], value)
+ *   reduce_T_OP (T *dest, const T *src, size_t nJob)           *dest = op (src[0], ..., src[nJob-1])
+ *   scan_T_OP   (T *dest, const T *src, size_t nJob)           dest[i] = op (src[0], ..., src[i])
+ *
+ * reduce and scan split the array in ranges (one per par_for chunk): each range is reduced
+ * sequentially, the partial results are combined, and scan then rescans each range starting
+ * from the combination of the ranges before it.
+ */
+#define DEFINE_OP_PATTERNS(T, OP) \
+\
+typedef struct Typed_Args_##T##_##OP { \
+	T *dest; \
+	const T *src; \
+	size_t nJob; \
+	size_t grain; \
+	T value; \
+	T *partial; \
+} Typed_Args_##T##_##OP; \
+\
+static inline void typed_map_range_##T##_##OP (size_t start, size_t end, void *arg) { \
+	Typed_Args_##T##_##OP *args = arg; \
+	T *dest = args->dest; \
+	const T *src = args->src; \
+	T value = args->value; \
+	for (size_t i = start; i < end; i++) \
+		dest[i] = PATTERNS_OP_##OP(src[i], value); \
+} \
+\
+static inline void typed_reduce_range_##T##_##OP (size_t start, size_t end, void *arg) { \
+	Typed_Args_##T##_##OP *args = arg; \
+	const T *src = args->src; \
+	for (size_t r = start; r < end; r++) { \
+		size_t first = r * args->grain; \
+		size_t last = first + args->grain < args->nJob ? first + args->grain : args->nJob; \
+		T acc = src[first]; \
+		for (size_t i = first + 1; i < last; i++) \
+			acc = PATTERNS_OP_##OP(acc, src[i]); \
+		args->partial[r] = acc; \
+	} \
+} \
+\
+static inline void typed_scan_range_##T##_##OP (size_t start, size_t end, void *arg) { \
+	Typed_Args_##T##_##OP *args = arg; \
+	T *dest = args->dest; \
+	const T *src = args->src; \
+	for (size_t r = start; r < end; r++) { \
+		size_t first = r * args->grain; \
+		size_t last = first + args->grain < args->nJob ? first + args->grain : args->nJob; \
+		T acc = r == 0 ? src[first] : PATTERNS_OP_##OP(args->partial[r-1], src[first]); \
+		dest[first] = acc; \
+		for (size_t i = first + 1; i < last; i++) \
+			dest[i] = acc = PATTERNS_OP_##OP(acc, src[i]); \
+	} \
+} \
+\
+static inline void map_##T##_##OP (T *dest, const T *src, size_t nJob, T value) { \
+	assert (dest != NULL); \
+	assert (src != NULL); \
+	Typed_Args_##T##_##OP args = { dest, src, nJob, 0, value, NULL }; \
+	par_for(0, nJob, 0, typed_map_range_##T##_##OP, &args); \
+} \
+\
+/* Reduces each range into args->partial, returns the # ranges */ \
+static inline size_t typed_partials_##T##_##OP (Typed_Args_##T##_##OP *args) { \
+	size_t nRanges = (args->nJob + args->grain - 1) / args->grain; \
+	args->partial = scratch_alloc(nRanges * sizeof(T)); \
+	assert (args->partial != NULL); \
+	par_for(0, nRanges, 1, typed_reduce_range_##T##_##OP, args); \
+	return nRanges; \
+} \
+\
+static inline void reduce_##T##_##OP (T *dest, const T *src, size_t nJob) { \
+	assert (dest != NULL); \
+	assert (src != NULL); \
+	if (nJob == 0) \
+		return; \
+	Typed_Args_##T##_##OP args = { dest, src, nJob, par_grain(nJob, 0) }; \
+	size_t nRanges = typed_partials_##T##_##OP(&args); \
+	T acc = args.partial[0]; \
+	for (size_t r = 1; r < nRanges; r++) \
+		acc = PATTERNS_OP_##OP(acc, args.partial[r]); \
+	*dest = acc; \
+	scratch_free(args.partial); \
+} \
+\
+static inline void scan_##T##_##OP (T *dest, const T *src, size_t nJob) { \
+	assert (dest != NULL); \
+	assert (src != NULL); \
+	if (nJob == 0) \
+		return; \
+	Typed_Args_##T##_##OP args = { dest, src, nJob, par_grain(nJob, 0) }; \
+	size_t nRanges = typed_partials_##T##_##OP(&args); \
+	for (size_t r = 1; r < nRanges; r++) \
+		args.partial[r] = PATTERNS_OP_##OP(args.partial[r-1], args.partial[r]); \
+	par_for(0, nRanges, 1, typed_scan_range_##T##_##OP, &args); \
+	scratch_free(args.partial); \
+}
+
+/*
+ * Patterns that do not need an operator:
+ *   pack_T   (T *dest, const T *src, size_t nJob, const int *filter)  returns the # packed elements
+ *   gather_T (T *dest, const T *src, size_t nJob, const int *filter, int nFilter)
+ */
+#define DEFINE_TYPED_PATTERNS(T) \
+\
+typedef struct Typed_Filter_Args_##T { \
+	T *dest; \
+	const T *src; \
+	size_t nJob; \
+	size_t grain; \
+	const int *filter; \
+	size_t *count; \
+} Typed_Filter_Args_##T; \
+\
+static inline void typed_count_range_##T (size_t start, size_t end, void *arg) { \
+	Typed_Filter_Args_##T *args = arg; \
+	const int *filter = args->filter; \
+	for (size_t r = start; r < end; r++) { \
+		size_t first = r * args->grain; \
+		size_t last = first + args->grain < args->nJob ? first + args->grain : args->nJob; \
+		size_t count = 0; \
+		for (size_t i = first; i < last; i++) \
+			count += filter[i] != 0; \
+		args->count[r] = count; \
+	} \
+} \
+\
+static inline void typed_pack_range_##T (size_t start, size_t end, void *arg) { \
+	Typed_Filter_Args_##T *args = arg; \
+	T *dest = args->dest; \
+	const T *src = args->src; \
+	const int *filter = args->filter; \
+	for (size_t r = start; r < end; r++) { \
+		size_t first = r * args->grain; \
+		size_t last = first + args->grain < args->nJob ? first + args->grain : args->nJob; \
+		size_t pos = args->count[r]; \
+		for (size_t i = first; i < last; i++) \
+			if (filter[i]) \
+				dest[pos++] = src[i]; \
+	} \
+} \
+\
+static inline void typed_gather_range_##T (size_t start, size_t end, void *arg) { \
+	Typed_Filter_Args_##T *args = arg; \
+	T *dest = args->dest; \
+	const T *src = args->src; \
+	const int *filter = args->filter; \
+	for (size_t i = start; i < end; i++) \
+		dest[i] = src[filter[i]]; \
+} \
+\
+static inline int pack_##T (T *dest, const T *src, size_t nJob, const int *filter) { \
+	assert (dest != NULL); \
+	assert (src != NULL); \
+	assert (filter != NULL); \
+	if (nJob == 0) \
+		return 0; \
+	Typed_Filter_Args_##T args = { dest, src, nJob, par_grain(nJob, 0), filter }; \
+	size_t nRanges = (nJob + args.grain - 1) / args.grain; \
+	args.count = scratch_alloc(nRanges * sizeof(size_t)); \
+	assert (args.count != NULL); \
+	par_for(0, nRanges, 1, typed_count_range_##T, &args); \
+	/* Turn the counts into the first position of each range */ \
+	size_t total = 0; \
+	for (size_t r = 0; r < nRanges; r++) { \
+		size_t count = args.count[r]; \
+		args.count[r] = total; \
+		total += count; \
+	} \
+	par_for(0, nRanges, 1, typed_pack_range_##T, &args); \
+	scratch_free(args.count); \
+	return total; \
+} \
+\
+static inline void gather_##T (T *dest, const T *src, size_t nJob, const int *filter, int nFilter) { \
+	assert (dest != NULL); \
+	assert (src != NULL); \
+	assert (filter != NULL); \
+	Typed_Filter_Args_##T args = { dest, src, nJob, 0, filter }; \
+	par_for(0, nFilter, 0, typed_gather_range_##T, &args); \
+}
+
+#endif
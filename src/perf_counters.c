@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counters.h"
+
+/*
+ * Implementation of the event counters.
+ * One counter is opened per event and per thread listed in /proc/self/task, disabled, and they
+ * are all enabled before the counted code and disabled after it, so that opening them is not
+ * counted. The counters inherit into the threads created meanwhile, which add their counts to
+ * the counter of their creator when they exit.
+ */
+
+const char *perf_event_names[PERF_EVENTS] = { "cycles", "instructions", "cache_misses", "llc_misses", "branch_misses" };
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+static int available[PERF_EVENTS];
+
+typedef struct Perf_Counter {
+	Perf_Event event;
+	int fd;
+} Perf_Counter;
+
+struct Perf_Group {
+	Perf_Counter *counters;
+	size_t n;
+	size_t capacity;
+};
+
+// Layout of a read with PERF_FORMAT_TOTAL_TIME_ENABLED and PERF_FORMAT_TOTAL_TIME_RUNNING
+typedef struct Perf_Reading {
+	uint64_t value;
+	uint64_t enabled;     // Time the counter was enabled
+	uint64_t running;     // Time it was actually on the hardware
+} Perf_Reading;
+
+static int openCounter(Perf_Event event, pid_t tid) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[event].type;
+	attr.config = events[event].config;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+int perf_events_init (void) {
+	int n = 0;
+
+	for (Perf_Event event = 0; event < PERF_EVENTS; event++) {
+		int fd = openCounter(event, 0);
+		available[event] = fd >= 0;
+		if (fd >= 0) {
+			close(fd);
+			n++;
+		}
+	}
+
+	return n;
+}
+
+int perf_event_available (Perf_Event event) {
+	assert (event < PERF_EVENTS);
+
+	return available[event];
+}
+
+static void addCounter(Perf_Group *group, Perf_Event event, int fd) {
+	if (group->n == group->capacity) {
+		group->capacity = group->capacity > 0 ? 2 * group->capacity : 64;
+		group->counters = realloc(group->counters, group->capacity * sizeof(Perf_Counter));
+		assert (group->counters != NULL);
+	}
+
+	group->counters[group->n++] = (Perf_Counter) { event, fd };
+}
+
+Perf_Group *perf_begin (void) {
+	DIR *tasks = opendir("/proc/self/task");
+	if (tasks == NULL)
+		return NULL;
+
+	Perf_Group *group = calloc(1, sizeof(Perf_Group));
+	assert (group != NULL);
+
+	struct dirent *entry;
+	while ((entry = readdir(tasks)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		// A thread that exits in the meantime just fails to open
+		pid_t tid = atoi(entry->d_name);
+		for (Perf_Event event = 0; event < PERF_EVENTS; event++) {
+			if (!available[event])
+				continue;
+			int fd = openCounter(event, tid);
+			if (fd >= 0)
+				addCounter(group, event, fd);
+		}
+	}
+	closedir(tasks);
+
+	if (group->n == 0) {
+		free(group);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < group->n; i++)
+		ioctl(group->counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+
+	return group;
+}
+
+void perf_end (Perf_Group *group, double counts[PERF_EVENTS]) {
+	assert (counts != NULL);
+
+	for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+		counts[event] = 0;
+	if (group == NULL)
+		return;
+
+	for (size_t i = 0; i < group->n; i++)
+		ioctl(group->counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+
+	for (size_t i = 0; i < group->n; i++) {
+		Perf_Reading reading;
+		if (read(group->counters[i].fd, &reading, sizeof(reading)) == sizeof(reading) && reading.running > 0)
+			counts[group->counters[i].event] += (double)reading.value * reading.enabled / reading.running;
+		close(group->counters[i].fd);
+	}
+
+	free(group->counters);
+	free(group);
+}
@@ -0,0 +1,63 @@
+#ifndef __PERF_COUNTERS_H
+#define __PERF_COUNTERS_H
+
+/*
+ * Hardware event counts of the whole process over a stretch of code, through the perf_event_open
+ * system call of Linux:
+ *
+ *   double counts[PERF_EVENTS];
+ *   Perf_Group *group = perf_begin ();
+ *   ... run the pattern ...
+ *   perf_end (group, counts);
+ *
+ * Each event is counted on every thread of the process, and the counts are added up, so that the
+ * work done by the workers of the backend is included. The threads that the counted ones create
+ * meanwhile are counted too once they exit; a thread that is still running when the counting
+ * ends, but was not there when it began, is missed, so the pools of workers should be started
+ * before.
+ *
+ * Only user space is counted. Events that the machine does not have, or that the kernel does not
+ * let the process count (see /proc/sys/kernel/perf_event_paranoid), are left out.
+ */
+
+typedef enum Perf_Event {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_LLC_MISSES,          // Read misses of the last level cache
+	PERF_BRANCH_MISSES,
+	PERF_EVENTS
+} Perf_Event;
+
+// Name of each event
+extern const char *perf_event_names[PERF_EVENTS];
+
+typedef struct Perf_Group Perf_Group;
+
+/*
+ * Finds which events can be counted. Returns their #, 0 if none can.
+ */
+int perf_events_init (void);
+
+/*
+ * Returns 1 if the event can be counted, 0 otherwise (or before perf_events_init).
+ */
+int perf_event_available (Perf_Event event);
+
+/*
+ * Starts counting the available events on every thread of the process. Returns NULL if none of
+ * them can be counted.
+ */
+Perf_Group *perf_begin (void);
+
+/*
+ * Stops counting, stores the count of each event in counts (0 for the events left out), and
+ * releases the group. Counts of events that the kernel had to multiplex are scaled up to the
+ * whole stretch.
+ */
+void perf_end (
+  Perf_Group *group,    // Group of perf_begin
+  double counts[PERF_EVENTS] // Count of each event
+);
+
+#endif
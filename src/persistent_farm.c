@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "patterns.h"
+#include "parallel.h"
+#include "persistent_farm.h"
+
+/*
+ * Implementation of the persistent farm.
+ * Submissions are queued by the callers and executed by a dispatcher thread, which takes every
+ * queued submission at once and runs them in parallel, each with farm_dynamic. Each submission
+ * is completed as soon as its own farm_dynamic returns, and the task that ran it goes on with the
+ * submissions queued meanwhile, so that they do not wait for the slowest one of the batch.
+ */
+
+struct Farm_Future {
+	void *dest;
+	void *src;
+	size_t nJob;
+	int done;
+	Persistent_Farm *farm;
+	Farm_Future *next;        // Next submission in the queue
+};
+
+struct Persistent_Farm {
+	void (*worker)(void *v1, const void *v2);
+	size_t sizeJob;
+	size_t nWorkers;
+
+	pthread_t dispatcher;
+	pthread_mutex_t lock;
+	pthread_cond_t submitted;  // Signalled when jobs are queued or the farm is closing
+	pthread_cond_t completed;  // Broadcast when a submission is done
+
+	Farm_Future *head;         // Queue of pending submissions
+	Farm_Future *tail;
+	size_t queuedJobs;         // # jobs in the queue
+	int closing;
+
+	Farm_Future **batch;       // Submissions run by the dispatcher
+};
+
+// Takes the first submission of the queue, NULL if it is empty. Called with the lock held
+static Farm_Future *dequeue(Persistent_Farm *farm) {
+	Farm_Future *first = farm->head;
+	if (first != NULL) {
+		farm->head = first->next;
+		if (farm->head == NULL)
+			farm->tail = NULL;
+		farm->queuedJobs -= first->nJob;
+	}
+	return first;
+}
+
+static void runBatch(size_t start, size_t end, void *arg) {
+	Persistent_Farm *farm = arg;
+	for (size_t i = start; i < end; i++) {
+		Farm_Future *future = farm->batch[i];
+		while (future != NULL) {
+			farm_dynamic(future->dest, future->src, future->nJob, farm->sizeJob, farm->worker, farm->nWorkers, 1);
+
+			pthread_mutex_lock(&farm->lock);
+			__atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+			pthread_cond_broadcast(&farm->completed);
+			future = dequeue(farm);
+			pthread_mutex_unlock(&farm->lock);
+		}
+	}
+}
+
+static void *dispatch(void *arg) {
+	Persistent_Farm *farm = arg;
+
+	pthread_mutex_lock(&farm->lock);
+	for (;;) {
+		while (farm->head == NULL && !farm->closing)
+			pthread_cond_wait(&farm->submitted, &farm->lock);
+
+		if (farm->head == NULL)
+			break;
+
+		// Take the whole queue
+		size_t nBatch = 0;
+		for (Farm_Future *f = farm->head; f != NULL; f = f->next)
+			nBatch++;
+
+		Farm_Future **batch = malloc(nBatch * sizeof(Farm_Future*));
+		assert (batch != NULL);
+		for (size_t i = 0; i < nBatch; i++)
+			batch[i] = dequeue(farm);
+		pthread_mutex_unlock(&farm->lock);
+
+		// The futures of the batch may be released by farm_wait as soon as they are done
+		farm->batch = batch;
+		par_for(0, nBatch, 1, runBatch, farm);
+		free(batch);
+
+		pthread_mutex_lock(&farm->lock);
+	}
+	pthread_mutex_unlock(&farm->lock);
+
+	return NULL;
+}
+
+Persistent_Farm *farm_create (void (*worker)(void *v1, const void *v2), size_t sizeJob, size_t nWorkers) {
+	assert (worker != NULL);
+	assert (nWorkers > 0);
+
+	Persistent_Farm *farm = malloc(sizeof(Persistent_Farm));
+	assert (farm != NULL);
+
+	farm->worker = worker;
+	farm->sizeJob = sizeJob;
+	farm->nWorkers = nWorkers;
+	farm->head = farm->tail = NULL;
+	farm->queuedJobs = 0;
+	farm->closing = 0;
+
+	pthread_mutex_init(&farm->lock, NULL);
+	pthread_cond_init(&farm->submitted, NULL);
+	pthread_cond_init(&farm->completed, NULL);
+
+	int error = pthread_create(&farm->dispatcher, NULL, dispatch, farm);
+	assert (error == 0);
+	(void) error;
+
+	return farm;
+}
+
+Farm_Future *farm_submit (Persistent_Farm *farm, void *dest, void *src, size_t nJob) {
+	assert (farm != NULL);
+	assert (dest != NULL);
+	assert (src != NULL);
+
+	Farm_Future *future = malloc(sizeof(Farm_Future));
+	assert (future != NULL);
+
+	future->dest = dest;
+	future->src = src;
+	future->nJob = nJob;
+	future->done = 0;
+	future->farm = farm;
+	future->next = NULL;
+
+	pthread_mutex_lock(&farm->lock);
+	assert (!farm->closing);
+	if (farm->tail == NULL)
+		farm->head = future;
+	else
+		farm->tail->next = future;
+	farm->tail = future;
+	farm->queuedJobs += nJob;
+	pthread_cond_signal(&farm->submitted);
+	pthread_mutex_unlock(&farm->lock);
+
+	return future;
+}
+
+int farm_test (Farm_Future *future) {
+	assert (future != NULL);
+
+	return __atomic_load_n(&future->done, __ATOMIC_ACQUIRE);
+}
+
+void farm_wait (Farm_Future *future) {
+	assert (future != NULL);
+
+	Persistent_Farm *farm = future->farm;
+
+	pthread_mutex_lock(&farm->lock);
+	while (!__atomic_load_n(&future->done, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&farm->completed, &farm->lock);
+	pthread_mutex_unlock(&farm->lock);
+
+	free(future);
+}
+
+size_t farm_queue_depth (Persistent_Farm *farm) {
+	assert (farm != NULL);
+
+	pthread_mutex_lock(&farm->lock);
+	size_t depth = farm->queuedJobs;
+	pthread_mutex_unlock(&farm->lock);
+
+	return depth;
+}
+
+void farm_destroy (Persistent_Farm *farm) {
+	assert (farm != NULL);
+
+	// The dispatcher empties the queue before it stops
+	pthread_mutex_lock(&farm->lock);
+	farm->closing = 1;
+	pthread_cond_signal(&farm->submitted);
+	pthread_mutex_unlock(&farm->lock);
+
+	pthread_join(farm->dispatcher, NULL);
+
+	pthread_cond_destroy(&farm->completed);
+	pthread_cond_destroy(&farm->submitted);
+	pthread_mutex_destroy(&farm->lock);
+	free(farm);
+}
@@ -0,0 +1,51 @@
+#ifndef __PERSISTENT_FARM_H
+#define __PERSISTENT_FARM_H
+
+/*
+ * Farm that outlives a single call: the worker function and the number of workers are fixed when
+ * the farm is created, and jobs are submitted to it over time. Each submission returns a future
+ * that tells when its jobs are done.
+ */
+
+typedef struct Persistent_Farm Persistent_Farm;
+
+typedef struct Farm_Future Farm_Future;
+
+Persistent_Farm *farm_create (
+  void (*worker)(void *v1, const void *v2),  // [ v1 = op (v2) ]
+  size_t sizeJob,       // Size of each job
+  size_t nWorkers       // # workers in the farm
+);
+
+/*
+ * Queues nJob jobs (a single job if nJob == 1): dest[i] = worker(src[i]).
+ * Both arrays must stay valid until the future is completed.
+ */
+Farm_Future *farm_submit (
+  Persistent_Farm *farm,
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob           // # elements in the source array
+);
+
+/*
+ * Returns 1 if the jobs of the future are done, 0 otherwise.
+ */
+int farm_test (Farm_Future *future);
+
+/*
+ * Waits until the jobs of the future are done, and releases the future.
+ */
+void farm_wait (Farm_Future *future);
+
+/*
+ * # jobs submitted to the farm that have not started yet.
+ */
+size_t farm_queue_depth (Persistent_Farm *farm);
+
+/*
+ * Waits for all the submitted jobs and releases the farm.
+ */
+void farm_destroy (Persistent_Farm *farm);
+
+#endif
@@ -1,10 +1,17 @@
 #ifndef __PREFIX_SCAN_H
 #define __PREFIX_SCAN_H
 
+#include <stddef.h>
+
 /*
  * Execute prefix sum algorithm, given arrays of input and output of size n_jobs, where each array element is of size size_job.
  * The operation to be applied in the prefix scan sould also be specified, as welll as the neutral element peratining to the operation
+ *
+ * Two trees are available, and scan runs the one selected in the variant registry (variants.h):
+ * prefix_scan_static keeps the whole tree in one array, prefix_scan_dynamic allocates each node.
  */
-void prefix_scan(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3));
+void prefix_scan_static(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3));
+
+void prefix_scan_dynamic(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3));
 
 #endif
\ No newline at end of file
@@ -1,8 +1,9 @@
 #include <stdlib.h>
 #include <string.h>
-#include <cilk/cilk.h>
 #include <assert.h>
 #include "prefix_scan.h"
+#include "parallel.h"
+#include "arena.h"
 
 /*
  * Implementation of parallel Prefix-Scan algorithm using an array-based binary tree.
@@ -27,8 +28,14 @@
  // Size of range[] in a tree node
 static size_t RANGE_MEM_SIZE = 2 * sizeof(size_t);
 
-// Total size of a tree node
-static size_t tree_node_size = 0;
+/*
+ * Total size of a tree node. Computed from the element size on each use rather than kept in a
+ * global, so that several scans with different element sizes can run at the same time.
+ */
+static size_t tree_node_size(size_t size_job) {
+	
+	return RANGE_MEM_SIZE + 2 * size_job;
+}
 
 /*
  * Get the total number of elements of a binary tree, given the size of the last tree level.
@@ -38,10 +45,26 @@ static size_t get_total_tree_size(size_t max_width) {
 	return 2 * max_width + 2 * max_width;
 }
 
+/*
+ * Arguments of a pass over the subtree rooted at a node, so that the passes can be run as tasks.
+ */
+typedef struct Pass_Args {
+	void *tree;
+	size_t node_index;
+	void *data;           // Input of the up pass, output of the down pass
+	size_t low;
+	size_t high;
+	size_t size_job;
+	void (*worker)(void *v1, const void *v2, const void *v3);
+} Pass_Args;
+
 /*
  * Up pass of the prefix scan algorithm, which builds a binary tree given an input.
  */
-static void up_pass(void *tree, size_t node_index, void *input, size_t low, size_t high, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
+static void up_pass(void *arg) {
+	Pass_Args *args = arg;
+	void *tree = args->tree, *input = args->data;
+	size_t node_index = args->node_index, low = args->low, high = args->high, size_job = args->size_job;
 	
 	size_t range[2] = {low, high};
 	memcpy(tree, &range, 2 * sizeof(size_t));
@@ -51,14 +74,14 @@ static void up_pass(void *tree, size_t node_index, void *input, size_t low, size
 	} else {
 		size_t mid = (low + high) / 2;
 		
-		void *left_child = tree + (node_index + 1) * tree_node_size;
-		void *right_child = left_child + tree_node_size;
+		void *left_child = tree + (node_index + 1) * tree_node_size(size_job);
+		void *right_child = left_child + tree_node_size(size_job);
 		
-		up_pass(left_child, 2 * node_index + 1, input, low, mid, size_job, worker);
-		cilk_spawn up_pass(right_child, 2 * node_index + 2, input, mid, high, size_job, worker);
+		Pass_Args left = { left_child, 2 * node_index + 1, input, low, mid, size_job, args->worker };
+		Pass_Args right = { right_child, 2 * node_index + 2, input, mid, high, size_job, args->worker };
+		par_invoke(up_pass, &left, up_pass, &right);
 		
-		cilk_sync;
-		worker(tree + RANGE_MEM_SIZE , left_child + RANGE_MEM_SIZE, right_child + RANGE_MEM_SIZE );
+		args->worker(tree + RANGE_MEM_SIZE , left_child + RANGE_MEM_SIZE, right_child + RANGE_MEM_SIZE );
 	}
 	
 }
@@ -66,44 +89,47 @@ static void up_pass(void *tree, size_t node_index, void *input, size_t low, size
 /*
  * Down pass of the prefix scan algorithm, which fills a binary tree's from_left field, outputting the results of the leaves to an output.
  */
-static void down_pass(void *tree, size_t node_index, void *output, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
+static void down_pass(void *arg) {
+	Pass_Args *args = arg;
+	void *tree = args->tree, *output = args->data;
+	size_t node_index = args->node_index, size_job = args->size_job;
+	void (*worker)(void *v1, const void *v2, const void *v3) = args->worker;
 	
 	size_t *range = ((size_t *) tree);
 	
 	if(*range + 1 == *(range +1)) {
 		worker(output + *range * size_job, tree + RANGE_MEM_SIZE, tree + RANGE_MEM_SIZE + size_job);
 	} else {
-		void *left_child = tree + (node_index + 1) * tree_node_size;
-		void *right_child = left_child + tree_node_size;
+		void *left_child = tree + (node_index + 1) * tree_node_size(size_job);
+		void *right_child = left_child + tree_node_size(size_job);
 		
 		memcpy(left_child + RANGE_MEM_SIZE + size_job, tree + RANGE_MEM_SIZE + size_job, size_job);
 		worker(right_child + RANGE_MEM_SIZE + size_job, tree + RANGE_MEM_SIZE + size_job, left_child + RANGE_MEM_SIZE);
 		
-		down_pass(left_child, 2 * node_index + 1, output, size_job, worker);
-		cilk_spawn down_pass(right_child, 2 * node_index + 2, output, size_job, worker);
-		
-		cilk_sync;
+		Pass_Args left = { left_child, 2 * node_index + 1, output, 0, 0, size_job, worker };
+		Pass_Args right = { right_child, 2 * node_index + 2, output, 0, 0, size_job, worker };
+		par_invoke(down_pass, &left, down_pass, &right);
 	}	
 }
 
 /*
  * Execute prefix scan algorithm.
  */
-void prefix_scan(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
-	
-	tree_node_size = RANGE_MEM_SIZE + 2 * size_job;
+void prefix_scan_static(void *input, void *output, size_t n_jobs, size_t size_job, void (*worker)(void *v1, const void *v2, const void *v3)) {
 	
-	void *tree = malloc(tree_node_size *  get_total_tree_size(n_jobs));	
+	void *tree = scratch_alloc(tree_node_size(size_job) *  get_total_tree_size(n_jobs));	
 	assert(tree != NULL);
 	
-	up_pass(tree, 0, input, 0, n_jobs, size_job, worker);
+	Pass_Args up = { tree, 0, input, 0, n_jobs, size_job, worker };
+	up_pass(&up);
 	
-	void *neutral_element = malloc(size_job);
+	void *neutral_element = scratch_alloc(size_job);
 	worker(neutral_element, NULL, NULL);
 	memcpy(tree + RANGE_MEM_SIZE + size_job, neutral_element, size_job);
 	
-	down_pass(tree, 0, output, size_job, worker);
+	Pass_Args down = { tree, 0, output, 0, 0, size_job, worker };
+	down_pass(&down);
 	
-	free(neutral_element);
-	free(tree);
+	scratch_free(neutral_element);
+	scratch_free(tree);
 }
\ No newline at end of file
@@ -6,37 +6,146 @@
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
-
-//#include "cilk/cilk.h"
-#include "cilk/cilk_api.h"
+#include <assert.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "patterns.h"
+#include "parallel.h"
+#include "arena.h"
+#include "numa_place.h"
+#include "chain.h"
+#include "patterns_async.h"
+#include "file_patterns.h"
+#include "perf_counters.h"
+#include "variants.h"
 
 #define TYPE double
 
+// Flags tester was built with, passed in by the Makefile
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+
+// Default regression threshold of the comparison of two result files, in percent (-T)
+#define COMPARE_THRESHOLD 5.0
+
 typedef enum MODE_ {
 	SEQ=0,
 	PAR=1,
 	ALT=2,
-	MODES=3
+	ALT2=3,
+	MODES=4
 } MODE;
 
 typedef enum EVAL_TYPE_ {
 	LINEAR_SIZE=0,
 	EXP_SIZE=1,
 	LINEAR_WEIGHT=2,
-	TYPES=3
+	NUMA_PLACEMENT=3,
+	STRONG_SCALING=4,
+	WEAK=5,
+	ELEMENT_SIZE=6,
+	BANDWIDTH=7,
+	VARIANTS=8,
+	DATA_MOVEMENT=9,
+	LOAD_IMBALANCE=10,
+	TYPES=11
 } EVAL_TYPE;
 
+/*
+ * Time of a run, in microseconds: the monotonic wall time, and the CPU time of the process, which
+ * adds up the time of all the workers. The wall time is negative if the pattern does not
+ * implement the mode.
+ */
+typedef struct Run_Time {
+	double wall;
+	double cpu;
+} Run_Time;
+
+static const Run_Time NO_RUN = { -1, -1 };
+
+typedef struct Run_Timer {
+	struct timespec wall;
+	struct timespec cpu;
+} Run_Timer;
+
+/*
+ * Summary of the timed runs of a pattern in a mode, in microseconds of wall time (but cpu).
+ */
+typedef struct Run_Stats {
+	int valid;            // 0 if the pattern does not implement the mode
+	double min;
+	double median;
+	double p95;
+	double mean;
+	double stddev;
+	double cpu;           // Mean CPU time
+	double events[PERF_EVENTS]; // Mean count of each hardware event per run, when counted
+} Run_Stats;
+
 static volatile size_t worker_weight;
 
-void variableWorkTest(double*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight);
-void variableSizeTester(double*** result, EVAL_TYPE eval_type, size_t runs, size_t start, size_t max_size, size_t step, size_t weight);
-double*** createResultsMatrix(size_t sizes, size_t functions);
-void freeResultsMatrix(double*** results, size_t sizes, size_t functions);
+// Largest # worker counts of a scaling sweep, and # stages of the pipelines of weak scaling
+#define MAX_WORKER_COUNTS 64
+
+// Worker count of a weak scaling run, whose pipelines have one stage per worker; 0 otherwise
+static size_t weak_workers = 0;
+
+// Cost ratio between the most and the least expensive jobs of workerSkewed
+#define SKEW_FACTOR 16
+
+void variableWorkTest(Run_Stats*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight);
+void variableSizeTester(Run_Stats*** result, EVAL_TYPE eval_type, size_t runs, size_t start, size_t max_size, size_t step, size_t weight);
+void numaPlacementTester(size_t runs, size_t start, size_t n_steps, size_t step, size_t weight);
+void strongScalingTester(size_t runs, size_t size, size_t weight, const char* worker_list, size_t arena_mb, int huge_pages, int pin_workers);
+void weakScalingTester(size_t runs, size_t size, size_t weight, const char* worker_list, size_t arena_mb, int huge_pages, int pin_workers);
+void elementSizeTester(size_t runs, size_t nJob);
+void bandwidthTester(size_t runs, size_t start, size_t n_steps, size_t step);
+void variantTester(size_t runs, size_t start, size_t n_steps, size_t step, size_t weight, const char* variant_list);
+void dataMovementTester(size_t runs, size_t nJob);
+void loadImbalanceTester(size_t runs, size_t nJob, size_t weight, const char* cost_list);
+Run_Stats*** createResultsMatrix(size_t sizes, size_t functions);
+void freeResultsMatrix(Run_Stats*** results, size_t sizes, size_t functions);
 int *createRandomBinaryFilter(size_t size);
-static void processArgs(int argc, char** argv, EVAL_TYPE* eval_type, size_t* runs, size_t* step, size_t* start, size_t* n_steps, size_t* weight);
-void saveResults(double*** results, size_t step, size_t start, size_t n_steps, char* filePattern);
+size_t powerFun(size_t base, size_t exp);
+static void processArgs(int argc, char** argv, EVAL_TYPE* eval_type, size_t* runs, size_t* step, size_t* start, size_t* n_steps, size_t* weight, size_t* arena_mb, int* huge_pages, int* pin_workers, size_t* warmup, char** worker_list, int* count_events, char** json_path, char** baseline_path, char** compare_path, double* threshold, char** variant_list, char** cost_list, double* mean);
+void saveResults(Run_Stats*** results, size_t step, size_t start, size_t n_steps, char* filePattern);
+void saveJson(Run_Stats*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight, const char* path);
+int compareResults(const char* baseline_path, const char* compare_path, double threshold);
+static FILE *openOutput(const char *fileName);
+
+// # untimed runs of each pattern and mode before the timed ones (-u)
+static size_t warmup_runs = 1;
+
+// 1 if the hardware events of the runs are counted (-C)
+static int count_events = 0;
+
+// Default mean cost of a job of the load imbalance sweep, in calls of workerHeavy
+#define COST_MEAN 4.0
+
+// Mean cost of a job of the load imbalance sweep, under every distribution (-m)
+static double cost_mean = COST_MEAN;
+
+static void timerStart(Run_Timer *timer) {
+	clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timer->cpu);
+}
+
+static double elapsedMicroseconds(const struct timespec *from, const struct timespec *to) {
+	return (to->tv_sec - from->tv_sec) * 1e6 + (to->tv_nsec - from->tv_nsec) / 1e3;
+}
+
+static Run_Time timerStop(Run_Timer *timer) {
+	struct timespec wall, cpu;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+	return (Run_Time) { elapsedMicroseconds(&timer->wall, &wall), elapsedMicroseconds(&timer->cpu, &cpu) };
+}
 
 /*static void workerAdd(void* a, const void* b, const void* c) {
 	// a = b + c
@@ -97,6 +206,20 @@ static void workerHeavy(void* a, const void* b) {
     }
 }
 
+static void workerHeavier(void* a, const void* b) {
+	// Four times the cost of workerHeavy, used to unbalance the pipeline stages
+	for(int i = 0; i < 4; i++)
+		workerHeavy(a, b);
+}
+
+static void workerSkewed(void* a, const void* b) {
+	// Between 1 and SKEW_FACTOR+1 times the cost of workerHeavy, growing with b (in [0, 1])
+	TYPE res_b = b == NULL ? 0.0 : *(TYPE *)b;
+	size_t repeats = 1 + (size_t)(SKEW_FACTOR * res_b);
+	for(size_t i = 0; i < repeats; i++)
+		workerHeavy(a, b);
+}
+
 static void workerHeavyTwo(void* a, const void* b, const void*c) {
 
 	TYPE res_b = b == NULL ? 0.0 : *(TYPE *)b;
@@ -129,76 +252,70 @@ static void workerHeavyTwo(void* a, const void* b, const void*c) {
     }
 }
 
-unsigned long evalMap(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalMap(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		map_seq (dest, src, nJob, size, workerHeavy);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		map (dest, src, nJob, size, workerHeavy);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalReduce(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalReduce(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		reduce_seq (dest, src, nJob, size, workerHeavyTwo);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		reduce (dest, src, nJob, size, workerHeavyTwo);
-		end = clock();
+		elapsed = timerStop(&timer);
 	}else if(mode == ALT) {
-		start = clock();
+		timerStart(&timer);
 		tiled_reduce (dest, src, nJob, size, workerHeavyTwo, 3);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalScan(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalScan(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		scan_seq (dest, src, nJob, size, workerHeavyTwo);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		scan (dest, src, nJob, size, workerHeavyTwo);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalPack(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalPack(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	int *filter = calloc(nJob, sizeof(*filter));
 	for(int i = 0; i < nJob; i++){
@@ -206,26 +323,24 @@ unsigned long evalPack(void* src, void* dest, size_t nJob, size_t size, MODE mod
 	}
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		pack_seq (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		pack (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
-	return us_cpu_time_used;
+	return elapsed;
 }
 
 
-unsigned long evalSplit(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalSplit(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	int *filter = calloc(nJob, sizeof(*filter));
 	for(int i = 0; i < nJob; i++){
@@ -233,126 +348,423 @@ unsigned long evalSplit(void* src, void* dest, size_t nJob, size_t size, MODE mo
 	}
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		split_seq (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		split (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalGather(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+Run_Time evalGather(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
 	int filterSize = nJob;	//using a filter the size of input for now
 	int *filter = createRandomBinaryFilter(filterSize);
 
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		gather_seq (dest, src, nJob, size, filter, filterSize);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		gather (dest, src, nJob, size, filter, filterSize);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
 	free(filter);
 
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalScatter(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+Run_Time evalScatter(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
 	int filterSize = nJob;
 	int *filter = createRandomBinaryFilter(filterSize);
 
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		scatter_seq (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		scatter (dest, src, nJob, size, filter);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
-
 	free(filter);
 
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalPipeline (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	void (*pipelineFunction[])(void*, const void*) = {
-			workerHeavy,
-			workerHeavy,
-			workerHeavy
-	};
-	int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+/*
+ * Fills the stages of the pipelines: three unbalanced ones, the middle one being the bottleneck,
+ * or, when scaling weakly, one balanced stage per worker. Returns the # stages.
+ */
+static size_t pipelineStages(void (*pipelineFunction[MAX_WORKER_COUNTS])(void*, const void*)) {
+	if (weak_workers == 0) {
+		pipelineFunction[0] = workerHeavy;
+		pipelineFunction[1] = workerHeavier;
+		pipelineFunction[2] = workerHeavy;
+		return 3;
+	}
+
+	size_t nStages = weak_workers < MAX_WORKER_COUNTS ? weak_workers : MAX_WORKER_COUNTS;
+	for (size_t i = 0; i < nStages; i++)
+		pipelineFunction[i] = workerHeavy;
+	return nStages;
+}
+
+// Each element goes through every stage, so when scaling weakly only the elements of one worker
+// are sent down the pipelines: their work then grows with the workers, like that of the others
+static size_t pipelineElements(size_t nJob) {
+	return weak_workers > 0 ? nJob / weak_workers : nJob;
+}
+
+Run_Time evalPipeline (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	void (*pipelineFunction[MAX_WORKER_COUNTS])(void*, const void*);
+	int nPipelineFunction = pipelineStages(pipelineFunction);
+	nJob = pipelineElements(nJob);
 
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		pipeline_seq (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		pipeline (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == ALT) {
-		start = clock();
+		timerStart(&timer);
 		pipeline_farm (dest, src, nJob, size, pipelineFunction, nPipelineFunction, 8);
-		end = clock();
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT2) {
+		timerStart(&timer);
+		pipeline_async (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else {
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
+	return elapsed;
+}
+
+Run_Time evalPipelineStages (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// Same stages as evalPipeline; the farms of weak scaling have one worker per stage
+	void (*pipelineFunction[MAX_WORKER_COUNTS])(void*, const void*);
+	int nPipelineFunction = pipelineStages(pipelineFunction);
+	nJob = pipelineElements(nJob);
+	size_t nFarms[MAX_WORKER_COUNTS] = { 2, 8, 2 };
+	if (weak_workers > 0)
+		for (int i = 0; i < nPipelineFunction; i++)
+			nFarms[i] = 1;
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		pipeline_seq (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		pipeline_farm_stages (dest, src, nJob, size, pipelineFunction, nPipelineFunction, NULL);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		pipeline_farm_stages (dest, src, nJob, size, pipelineFunction, nPipelineFunction, nFarms);
+		elapsed = timerStop(&timer);
+	} else {
+		return NO_RUN;
+	}
 
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-unsigned long evalFarm (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
-	clock_t start, end;
-	unsigned long us_cpu_time_used;
+Run_Time evalFarm (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
 	if( mode == SEQ) {
-		start = clock();
+		timerStart(&timer);
 		farm_seq (dest, src, nJob, size, workerHeavy, 3);
-		end = clock();
+		elapsed = timerStop(&timer);
 	} else if (mode == PAR) {
-		start = clock();
+		timerStart(&timer);
 		farm (dest, src, nJob, size, workerHeavy, 3);
-		end = clock();
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		farm_dynamic (dest, src, nJob, size, workerHeavy, 3, 1);
+		elapsed = timerStop(&timer);
 	} else {
-		return -1;
+		return NO_RUN;
+	}
+
+	return elapsed;
+}
+
+Run_Time evalFarmSkewed (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// Job costs grow with their position, so the last batch of the static farm is the straggler
+	TYPE *skewed = malloc(nJob * size);
+	for(size_t i = 0; i < nJob; i++)
+		skewed[i] = (TYPE)i / nJob;
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		farm_seq (dest, skewed, nJob, size, workerSkewed, 3);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		farm (dest, skewed, nJob, size, workerSkewed, 3);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		farm_dynamic (dest, skewed, nJob, size, workerSkewed, 3, 1);
+		elapsed = timerStop(&timer);
+	} else {
+		free(skewed);
+		return NO_RUN;
+	}
+
+	free(skewed);
+
+	return elapsed;
+}
+
+Run_Time evalChain (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// map -> pack -> reduce, one pattern after the other or fused in a chain
+	int *filter = createRandomBinaryFilter(nJob);
+	TYPE *mapped = malloc(nJob * size);
+	TYPE *packed = malloc(nJob * size);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		map_seq (mapped, src, nJob, size, workerHeavy);
+		int nPacked = pack_seq (packed, mapped, nJob, size, filter);
+		reduce_seq (dest, packed, nPacked, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		map (mapped, src, nJob, size, workerHeavy);
+		int nPacked = pack (packed, mapped, nJob, size, filter);
+		reduce (dest, packed, nPacked, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		Chain *chain = chain_create (src, nJob, size);
+		chain_map (chain, workerHeavy, size);
+		chain_pack (chain, filter);
+		chain_reduce (chain, dest, workerHeavyTwo);
+		chain_destroy (chain);
+		elapsed = timerStop(&timer);
+	} else {
+		free(packed);
+		free(mapped);
+		free(filter);
+		return NO_RUN;
+	}
+
+	free(packed);
+	free(mapped);
+	free(filter);
+
+	return elapsed;
+}
+
+Run_Time evalScanPair (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// Two independent scans, one after the other or both in flight
+	TYPE *other = malloc(nJob * size);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		scan_seq (dest, src, nJob, size, workerHeavyTwo);
+		scan_seq (other, src, nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		scan (dest, src, nJob, size, workerHeavyTwo);
+		scan (other, src, nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		Async_Handle *first = async_scan (dest, src, nJob, size, workerHeavyTwo);
+		Async_Handle *second = async_scan (other, src, nJob, size, workerHeavyTwo);
+		async_wait (first);
+		async_wait (second);
+		elapsed = timerStop(&timer);
+	} else {
+		free(other);
+		return NO_RUN;
+	}
+
+	free(other);
+
+	return elapsed;
+}
+
+Run_Time evalScanFile (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// In memory, or streamed from a file to a file (the input file is written outside of the timing)
+	char srcPath[] = "/tmp/testerXXXXXX";
+	char destPath[] = "/tmp/testerXXXXXX";
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		scan_seq (dest, src, nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		scan (dest, src, nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		int srcFd = mkstemp(srcPath);
+		int destFd = mkstemp(destPath);
+		int written = srcFd >= 0 && destFd >= 0 && write(srcFd, src, nJob * size) == nJob * size;
+		if (!written)
+			perror("evalScanFile");
+		if (srcFd >= 0)
+			close(srcFd);
+		if (destFd >= 0)
+			close(destFd);
+
+		if (written) {
+			timerStart(&timer);
+			if (scan_file (destPath, srcPath, size, workerHeavyTwo) != 0)
+				perror("evalScanFile");
+			elapsed = timerStop(&timer);
+		}
+
+		if (destFd >= 0)
+			unlink(destPath);
+		if (srcFd >= 0)
+			unlink(srcPath);
+	} else {
+		return NO_RUN;
+	}
+
+	return elapsed;
+}
+
+// # elements of each problem of evalScanBatch
+#define BATCH_PROBLEM_SIZE 1000
+
+Run_Time evalScanBatch (void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// Many small independent scans, one call each or in a single batch
+	size_t nProblems = (nJob + BATCH_PROBLEM_SIZE - 1) / BATCH_PROBLEM_SIZE;
+	Pattern_Problem *problems = malloc(nProblems * sizeof(Pattern_Problem));
+	for(size_t i = 0; i < nProblems; i++) {
+		size_t first = i * BATCH_PROBLEM_SIZE;
+		problems[i] = (Pattern_Problem) { dest + first * size, src + first * size, nJob - first < BATCH_PROBLEM_SIZE ? nJob - first : BATCH_PROBLEM_SIZE };
+	}
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		for(size_t i = 0; i < nProblems; i++)
+			scan_seq (problems[i].dest, problems[i].src, problems[i].nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		for(size_t i = 0; i < nProblems; i++)
+			scan (problems[i].dest, problems[i].src, problems[i].nJob, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		scan_batch (problems, nProblems, size, workerHeavyTwo);
+		elapsed = timerStop(&timer);
+	} else {
+		free(problems);
+		return NO_RUN;
 	}
 
-	us_cpu_time_used = (unsigned long)((((double) (end - start)) / (CLOCKS_PER_SEC/ (1000*1000))) ); // in microseconds
+	free(problems);
+
+	return elapsed;
+}
+
+
+// Pattern and index of the variant run by evalVariant
+static Variant_Pattern variant_pattern;
+static size_t variant_index;
+
+/*
+ * Runs a registered variant, or the sequential version of its pattern, with the workers of the
+ * main set.
+ */
+Run_Time evalVariant(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	void (*pipelineFunction[])(void*, const void*) = {
+			workerHeavy,
+			workerHeavier,
+			workerHeavy
+	};
+	int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+	Variant_Function function = variant_get(variant_pattern, variant_index);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if (mode != SEQ && mode != PAR)
+		return NO_RUN;
+
+	timerStart(&timer);
+	switch (variant_pattern) {
+	case VARIANT_REDUCE:
+		if (mode == SEQ)
+			reduce_seq (dest, src, nJob, size, workerHeavyTwo);
+		else
+			function.reduce (dest, src, nJob, size, workerHeavyTwo);
+		break;
+	case VARIANT_SCAN:
+		if (mode == SEQ)
+			scan_seq (dest, src, nJob, size, workerHeavyTwo);
+		else
+			function.scan (dest, src, nJob, size, workerHeavyTwo);
+		break;
+	case VARIANT_PIPELINE:
+		if (mode == SEQ)
+			pipeline_seq (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		else
+			function.pipeline (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		break;
+	default:
+		break;
+	}
+	elapsed = timerStop(&timer);
 
-	return us_cpu_time_used;
+	return elapsed;
 }
 
-typedef unsigned long (*EVALFUNCTION)(void *, void*, size_t, size_t, MODE);
+typedef Run_Time (*EVALFUNCTION)(void *, void*, size_t, size_t, MODE);
 
 EVALFUNCTION evalFunction[] = {
 		evalMap,
@@ -363,7 +775,13 @@ EVALFUNCTION evalFunction[] = {
 		evalGather,
 		evalScatter,
 		evalPipeline,
-		evalFarm
+		evalPipelineStages,
+		evalFarm,
+		evalFarmSkewed,
+		evalChain,
+		evalScanPair,
+		evalScanFile,
+		evalScanBatch
 };
 
 
@@ -376,7 +794,13 @@ char *evalNames[] = {
 		"Gather",
 		"Scatter",
 		"Pipeline",
-		"Farm"
+		"PipelineStages",
+		"Farm",
+		"FarmSkewed",
+		"Chain",
+		"ScanPair",
+		"ScanFile",
+		"ScanBatch"
 };
 
 char *altNames[] = {
@@ -388,6 +812,30 @@ char *altNames[] = {
 		"",
 		"",
 		"PipelineFarm",
+		"PipelineStagesFixed",
+		"FarmDynamic",
+		"FarmDynamic",
+		"ChainFused",
+		"ScanPairAsync",
+		"ScanFileStreamed",
+		"ScanBatched"
+};
+
+char *alt2Names[] = {
+		"",
+		"",
+		"",
+		"",
+		"",
+		"",
+		"",
+		"PipelineAsync",
+		"",
+		"",
+		"",
+		"",
+		"",
+		"",
 		""
 };
 
@@ -412,146 +860,1948 @@ int *createRandomBinaryFilter(size_t size) {
 	return filter;
 }
 
-// tester -n 10 -s 1000
-int main(int argc, char** argv) {
-
-	// Default values
-	size_t runs = 1;
-	size_t step = 10000;
-	size_t start = 10000;
-	size_t n_steps = 10;
-	size_t weight = 1;
-	EVAL_TYPE eval_type = LINEAR_SIZE;
+/*
+ * Element types of the element size sweep, each with its own workers: v1 = v2 + 1 for the maps
+ * and the pipeline, and v1 = v2 + v3 for the reductions and scans, where a NULL operand is 0. The
+ * opaque records only update their key and copy the rest, as the records of an application
+ * would be moved around.
+ */
+typedef struct Element_Type {
+	const char *name;
+	size_t size;
+	void (*fill)(void *v1);   // Random value
+	void (*mapWorker)(void *v1, const void *v2);
+	void (*reduceWorker)(void *v1, const void *v2, const void *v3);
+} Element_Type;
+
+static void fillInt32(void* a) {
+	*(int32_t *)a = rand() % 1000;
+}
 
-	// Initialize arguments
-	processArgs(argc, argv, &eval_type, &runs, &step, &start, &n_steps, &weight);
+static void mapInt32(void* a, const void* b) {
+	*(int32_t *)a = *(const int32_t *)b + 1;
+}
 
-	printf("runs=%lu \t step=%lu \t start=%lu \t n_steps=%lu cilk_workers=%d \n", runs, step, start, n_steps, __cilkrts_get_nworkers());
+static void reduceInt32(void* a, const void* b, const void* c) {
+	// Wraps around instead of overflowing
+	uint32_t res_b = b == NULL ? 0 : *(const int32_t *)b;
+	uint32_t res_c = c == NULL ? 0 : *(const int32_t *)c;
+	*(int32_t *)a = res_b + res_c;
+}
 
-	//size_t sizes = ((n_steps-start) / (double)step)+1;
-	double*** results = createResultsMatrix(n_steps, nEvalFunctions);
+static void fillFloat(void* a) {
+	*(float *)a = drand48();
+}
 
-	if( eval_type == LINEAR_SIZE || eval_type == EXP_SIZE )
-		variableSizeTester(results, eval_type, runs, start, n_steps, step, weight);
-	else
-		variableWorkTest(results, eval_type, runs, start, n_steps, step, weight);
+static void mapFloat(void* a, const void* b) {
+	*(float *)a = *(const float *)b + 1;
+}
 
-	saveResults(results, step, start, n_steps, "./plots/%s%s");
+static void reduceFloat(void* a, const void* b, const void* c) {
+	float res_b = b == NULL ? 0 : *(const float *)b;
+	float res_c = c == NULL ? 0 : *(const float *)c;
+	*(float *)a = res_b + res_c;
+}
 
-	freeResultsMatrix(results, n_steps, nEvalFunctions);
+static void fillDouble(void* a) {
+	*(double *)a = drand48();
+}
 
-	return 0;
+static void mapDouble(void* a, const void* b) {
+	*(double *)a = *(const double *)b + 1;
 }
 
-void variableWorkTest(double*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight) {
+static void reduceDouble(void* a, const void* b, const void* c) {
+	double res_b = b == NULL ? 0 : *(const double *)b;
+	double res_c = c == NULL ? 0 : *(const double *)c;
+	*(double *)a = res_b + res_c;
+}
 
-	size_t current_size = start;
-	TYPE* src = createRandomArray(current_size);
-	TYPE* dest = malloc (current_size*sizeof(TYPE));
+#define OPAQUE_ELEMENT(N) \
+typedef struct Opaque##N { \
+	uint32_t key; \
+	char payload[N - sizeof(uint32_t)]; \
+} Opaque##N; \
+\
+static void fillOpaque##N(void* a) { \
+	Opaque##N *record = a; \
+	record->key = rand() % 1000; \
+	for (size_t i = 0; i < sizeof(record->payload); i++) \
+		record->payload[i] = rand(); \
+} \
+\
+static void mapOpaque##N(void* a, const void* b) { \
+	Opaque##N record = *(const Opaque##N *)b; \
+	record.key++; \
+	*(Opaque##N *)a = record; \
+} \
+\
+static void reduceOpaque##N(void* a, const void* b, const void* c) { \
+	if (b == NULL || c == NULL) { \
+		const void *other = b == NULL ? c : b; \
+		if (other == NULL) \
+			memset(a, 0, N); \
+		else \
+			*(Opaque##N *)a = *(const Opaque##N *)other; \
+		return; \
+	} \
+	Opaque##N record = *(const Opaque##N *)b; \
+	record.key += ((const Opaque##N *)c)->key; \
+	*(Opaque##N *)a = record; \
+}
 
-	for(size_t i = 0; i < n_steps; i++) {
+OPAQUE_ELEMENT(16)
+OPAQUE_ELEMENT(32)
+OPAQUE_ELEMENT(64)
+OPAQUE_ELEMENT(128)
+OPAQUE_ELEMENT(256)
+
+#define OPAQUE_TYPE(N) { "opaque" #N, N, fillOpaque##N, mapOpaque##N, reduceOpaque##N }
+
+static const Element_Type elementTypes[] = {
+		{ "int32", sizeof(int32_t), fillInt32, mapInt32, reduceInt32 },
+		{ "float", sizeof(float), fillFloat, mapFloat, reduceFloat },
+		{ "double", sizeof(double), fillDouble, mapDouble, reduceDouble },
+		OPAQUE_TYPE(16),
+		OPAQUE_TYPE(32),
+		OPAQUE_TYPE(64),
+		OPAQUE_TYPE(128),
+		OPAQUE_TYPE(256)
+};
 
-		//printf("Current_size: %lu\n", current_size);
+int nElementTypes = sizeof (elementTypes)/sizeof(elementTypes[0]);
 
-		worker_weight = weight + i*step;
+// Element type of the current step of the element size sweep
+static const Element_Type *element_type;
 
-		for(size_t f = 0; f < nEvalFunctions; f++) {
-			//printf("Current pattern: %s\n", evalNames[f]);
-			for(size_t run = 0; run < runs; run++) {
-				// printf("Size=%lu \t pattern=%s \t run=%lu/%lu \n", current_size, evalNames[f], run+1, runs);
+// Fraction of the elements selected by the filters of pack and split in the sized set
+static double filter_selectivity = 0.5;
 
-				// Parallel
-				unsigned long t;
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), PAR);
-				printf("parallel_%s %lu microseconds\n", evalNames[f], t);
+// Filter that selects each element with probability selectivity
+static int *createSelectiveFilter(size_t size, double selectivity) {
+	int *filter = malloc(sizeof(int) * size);
 
-				results[i][f][PAR] += t;
+	for(size_t i = 0; i < size; i++)
+		filter[i] = drand48() < selectivity;
 
-				// Seq
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), SEQ);
-				printf("sequential_%s %lu microseconds\n", evalNames[f], t);
+	return filter;
+}
 
-				results[i][f][SEQ] += t;
+/*
+ * Distributions of the indices of gather and scatter: in order, every INDEX_STRIDE-th element
+ * (wrapping around with an offset, so that all are used), uniformly random, Zipf distributed
+ * (with the hot elements spread over the array), and runs of INDEX_CLUSTER consecutive elements
+ * from random places.
+ */
+typedef enum Index_Distribution {
+	INDEX_SEQUENTIAL,
+	INDEX_STRIDED,
+	INDEX_UNIFORM,
+	INDEX_ZIPF,
+	INDEX_CLUSTERED,
+	INDEX_DISTRIBUTIONS
+} Index_Distribution;
+
+static const char *indexDistributionNames[INDEX_DISTRIBUTIONS] = { "sequential", "strided", "uniform", "zipf", "clustered" };
+
+// # elements between the indices of the strided distribution (two cache lines of doubles)
+#define INDEX_STRIDE 16
+
+// Exponent of the Zipf distribution
+#define INDEX_ZIPF_EXPONENT 1.0
+
+// # consecutive indices of each run of the clustered distribution
+#define INDEX_CLUSTER 64
+
+// Distribution of the indices of gather and scatter in the sized set
+static Index_Distribution index_distribution = INDEX_UNIFORM;
+
+// Rank of a Zipf distribution, from its cumulative distribution over n ranks
+static size_t zipfRank(const double *cdf, size_t n) {
+	double u = drand48();
+	size_t low = 0, high = n - 1;
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		if (cdf[mid] < u)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
 
-				// Alternative
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), ALT);
-				printf("sequential_%s %lu microseconds\n", evalNames[f], t);
+// size indices of elements of an array of size elements, in a distribution
+static int *createIndices(size_t size, Index_Distribution distribution) {
+	int *indices = malloc(sizeof(int) * size);
+	double *cdf = NULL;
+
+	if (distribution == INDEX_ZIPF && size > 0) {
+		cdf = malloc(sizeof(double) * size);
+		double sum = 0;
+		for (size_t rank = 0; rank < size; rank++)
+			cdf[rank] = sum += pow(rank + 1, -INDEX_ZIPF_EXPONENT);
+		for (size_t rank = 0; rank < size; rank++)
+			cdf[rank] /= sum;
+	}
 
-				results[i][f][ALT] += t;
-			}
+	size_t base = 0;
+	for(size_t i = 0; i < size; i++) {
+		switch (distribution) {
+		case INDEX_SEQUENTIAL:
+			indices[i] = i;
+			break;
+		case INDEX_STRIDED:
+			indices[i] = (i * INDEX_STRIDE + i * INDEX_STRIDE / size) % size;
+			break;
+		case INDEX_ZIPF:
+			// A multiplicative hash spreads the ranks, the hot elements do not share cache lines
+			indices[i] = (zipfRank(cdf, size) * 2654435761u) % size;
+			break;
+		case INDEX_CLUSTERED:
+			if (i % INDEX_CLUSTER == 0)
+				base = size > INDEX_CLUSTER ? lrand48() % (size - INDEX_CLUSTER) : 0;
+			indices[i] = (base + i % INDEX_CLUSTER) % size;
+			break;
+		default:
+			indices[i] = lrand48() % size;
+			break;
 		}
-		free(src);
-		free(dest);
 	}
 
-	// Compute the average between the different runs
-	if( runs >= 1 ) {
-		for(size_t i = 0; i < n_steps; i++) {
-			size_t worker_weight = weight + i*step;
-			printf("worker weight=%lu \t runs=%lu\n", worker_weight, runs );
-			printf("Pattern \t\t\t Sequential 	\t Parallel \t Parallel2\n");
-			for(size_t j = 0; j < nEvalFunctions; j++){
-				for(size_t k = 0; k < 2; k++){
-					results[i][j][k] = results[i][j][k] / runs;
-				}
+	free(cdf);
 
-				printf("%s \t\t\t %f us \t %f us", evalNames[j], results[i][j][SEQ], results[i][j][PAR]);
-				if( results[i][j][PAR] > 0 ) {
-					printf( "\t %f us", results[i][j][PAR]);
-				}
-				printf("\n");
-			}
-			printf("\n");
-		}
+	return indices;
+}
+
+Run_Time evalSizedMap(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		map_seq (dest, src, nJob, size, element_type->mapWorker);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		map (dest, src, nJob, size, element_type->mapWorker);
+		elapsed = timerStop(&timer);
 	}
+
+	return elapsed;
 }
 
+Run_Time evalSizedReduce(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		reduce_seq (dest, src, nJob, size, element_type->reduceWorker);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		reduce (dest, src, nJob, size, element_type->reduceWorker);
+		elapsed = timerStop(&timer);
+	}
 
-void saveResults(double*** results, size_t step, size_t start, size_t n_steps, char* filePattern) {
+	return elapsed;
+}
 
-	FILE * fp;
+Run_Time evalSizedScan(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
-	for( size_t pattern = 0; pattern < nEvalFunctions; pattern++) {
-		// Compute file name
-		char fileName[strlen(filePattern)+strlen(evalNames[pattern])+4];
-		sprintf(fileName, filePattern, evalNames[pattern], ".csv");
+	if( mode == SEQ) {
+		timerStart(&timer);
+		scan_seq (dest, src, nJob, size, element_type->reduceWorker);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		scan (dest, src, nJob, size, element_type->reduceWorker);
+		elapsed = timerStop(&timer);
+	}
 
-		fp = fopen (fileName, "w");
+	return elapsed;
+}
 
-		if(results[0][pattern][ALT] > 0)
-			fprintf (fp, ";%s;%s;%s\n", "sequential", "parallel", altNames[pattern]);
-		else
-			fprintf (fp, ";%s;%s\n", "sequential", "parallel");
+Run_Time evalSizedPack(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	int *filter = createSelectiveFilter(nJob, filter_selectivity);
 
-		for( size_t i = 0; i < n_steps; i++) {
-			if(results[i][pattern][ALT] > 0)
-				fprintf (fp, "%lu;%f;%f;%f\n", start+i*step, results[i][pattern][SEQ], results[i][pattern][PAR], results[i][pattern][ALT]);
-			else
-				fprintf (fp, "%lu;%f;%f\n", start+i*step, results[i][pattern][SEQ], results[i][pattern][PAR]);
-		}
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
-		fclose (fp);
+	if( mode == SEQ) {
+		timerStart(&timer);
+		pack_seq (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		pack (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
 	}
+
+	free(filter);
+
+	return elapsed;
 }
 
-/*void producePlotScript(char* filePattern, char* patternName, ) {
+Run_Time evalSizedSplit(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	int *filter = createSelectiveFilter(nJob, filter_selectivity);
 
-}*/
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
 
-static void processArgs(int argc, char** argv, EVAL_TYPE* eval_type, size_t* runs, size_t* step, size_t* start, size_t* n_steps, size_t* weight) {
-	int c;
+	if( mode == SEQ) {
+		timerStart(&timer);
+		split_seq (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		split (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
+	}
 
-	opterr = 0;
+	free(filter);
 
-	while ((c = getopt(argc, argv, "r:s:i:n:t:w:")) != -1)
-		switch (c) {
-		case 't':
-			*eval_type = strtol (optarg, NULL, 10);
-			break;
-		case 'w':
-			*weight = strtol (optarg, NULL, 10);
-			break;
-		case 'r':
+	return elapsed;
+}
+
+Run_Time evalSizedGather(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	int *filter = createIndices(nJob, index_distribution);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		gather_seq (dest, src, nJob, size, filter, nJob);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		gather (dest, src, nJob, size, filter, nJob);
+		elapsed = timerStop(&timer);
+	}
+
+	free(filter);
+
+	return elapsed;
+}
+
+Run_Time evalSizedScatter(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	int *filter = createIndices(nJob, index_distribution);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		scatter_seq (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		scatter (dest, src, nJob, size, filter);
+		elapsed = timerStop(&timer);
+	}
+
+	free(filter);
+
+	return elapsed;
+}
+
+Run_Time evalSizedPipeline(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	void (*pipelineFunction[])(void*, const void*) = {
+			element_type->mapWorker,
+			element_type->mapWorker
+	};
+	int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		pipeline_seq (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		pipeline (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	}
+
+	return elapsed;
+}
+
+EVALFUNCTION sizedFunction[] = {
+		evalSizedMap,
+		evalSizedReduce,
+		evalSizedScan,
+		evalSizedPack,
+		evalSizedSplit,
+		evalSizedGather,
+		evalSizedScatter,
+		evalSizedPipeline
+};
+
+char *sizedNames[] = {
+		"Map",
+		"Reduce",
+		"Scan",
+		"Pack",
+		"Split",
+		"Gather",
+		"Scatter",
+		"Pipeline"
+};
+
+int nSizedFunctions = sizeof (sizedFunction)/sizeof(sizedFunction[0]);
+
+/*
+ * Least traffic of each pattern of the sized set, per source element: the # elements and the #
+ * filter ints that it has to read or write. pack writes the half of the elements selected by its
+ * filter at the default selectivity, and the pipeline carries the elements through its stages in
+ * place.
+ */
+static const double sizedTraffic[][2] = {
+		{ 2, 0 },     // Map
+		{ 1, 0 },     // Reduce
+		{ 2, 0 },     // Scan
+		{ 1.5, 1 },   // Pack
+		{ 2, 1 },     // Split
+		{ 2, 1 },     // Gather
+		{ 2, 1 },     // Scatter
+		{ 2, 0 }      // Pipeline
+};
+
+// Bytes moved by a pattern of the sized set on nJob elements of sizeJob bytes
+static double sizedBytes(size_t f, size_t nJob, size_t sizeJob) {
+	return nJob * (sizedTraffic[f][0] * sizeJob + sizedTraffic[f][1] * sizeof(int));
+}
+
+/*
+ * STREAM kernels, run by the workers over arrays much larger than the caches:
+ * copy a = b, scale a = q * b, add a = b + c and triad a = b + q * c.
+ */
+typedef enum Stream_Kernel {
+	STREAM_COPY,
+	STREAM_SCALE,
+	STREAM_ADD,
+	STREAM_TRIAD,
+	STREAM_KERNELS
+} Stream_Kernel;
+
+static const char *streamNames[STREAM_KERNELS] = { "copy", "scale", "add", "triad" };
+
+// Bytes read and written per element by each kernel
+static const size_t streamBytes[STREAM_KERNELS] = { 16, 16, 24, 24 };
+
+// # elements of each STREAM array (128 MB)
+#define STREAM_ELEMENTS (1 << 24)
+
+// # times each kernel runs, the fastest one counts
+#define STREAM_TIMES 5
+
+typedef struct Stream_Args {
+	Stream_Kernel kernel;
+	double *a;
+	const double *b;
+	const double *c;
+	double q;
+} Stream_Args;
+
+static void streamRange(size_t start, size_t end, void *arg) {
+	Stream_Args *args = arg;
+	double *a = args->a;
+	const double *b = args->b, *c = args->c;
+	double q = args->q;
+
+	switch (args->kernel) {
+	case STREAM_COPY:
+		for (size_t i = start; i < end; i++)
+			a[i] = b[i];
+		break;
+	case STREAM_SCALE:
+		for (size_t i = start; i < end; i++)
+			a[i] = q * b[i];
+		break;
+	case STREAM_ADD:
+		for (size_t i = start; i < end; i++)
+			a[i] = b[i] + c[i];
+		break;
+	case STREAM_TRIAD:
+		for (size_t i = start; i < end; i++)
+			a[i] = b[i] + q * c[i];
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Measures the memory bandwidth that the workers reach with each STREAM kernel, and returns the
+ * best of them in GB/s. The arrays are placed by the workers, like those of the patterns.
+ */
+static double measurePeakBandwidth(void) {
+	double *a = numa_alloc_first_touch(STREAM_ELEMENTS, sizeof(double));
+	double *b = numa_alloc_first_touch(STREAM_ELEMENTS, sizeof(double));
+	double *c = numa_alloc_first_touch(STREAM_ELEMENTS, sizeof(double));
+	double peak = 0;
+
+	for (Stream_Kernel kernel = STREAM_COPY; kernel < STREAM_KERNELS; kernel++) {
+		Stream_Args args = { kernel, a, b, c, 3.0 };
+		double best = -1;
+
+		for (size_t t = 0; t < STREAM_TIMES; t++) {
+			Run_Timer timer;
+			timerStart(&timer);
+			par_for(0, STREAM_ELEMENTS, 0, streamRange, &args);
+			double elapsed = timerStop(&timer).wall;
+			if (best < 0 || elapsed < best)
+				best = elapsed;
+		}
+
+		double bandwidth = best > 0 ? (double)STREAM_ELEMENTS * streamBytes[kernel] / (best * 1e3) : 0;
+		printf("stream %s \t %f GB/s\n", streamNames[kernel], bandwidth);
+		if (bandwidth > peak)
+			peak = bandwidth;
+	}
+
+	numa_release(a);
+	numa_release(b);
+	numa_release(c);
+
+	return peak;
+}
+
+/*
+ * Pins the workers to the NUMA nodes (-P), before anything is allocated, and creates the scratch
+ * arena for the temporaries of the patterns (-a MB, -H for huge pages).
+ */
+static Scratch_Arena *setupRuntime(size_t arena_mb, int huge_pages, int pin_workers) {
+	if (pin_workers && numa_pin_workers() != 0)
+		fprintf(stderr, "Could not pin the workers to their nodes\n");
+
+	Scratch_Arena *arena = NULL;
+	if (arena_mb > 0) {
+		arena = arena_create(arena_mb << 20, huge_pages ? ARENA_HUGE_PAGES : 0);
+		if (arena == NULL)
+			fprintf(stderr, "Could not map a %lu MB arena, using the heap\n", arena_mb);
+		arena_set_current(arena);
+	}
+
+	return arena;
+}
+
+// tester -n 10 -s 1000
+int main(int argc, char** argv) {
+
+	// Default values
+	size_t runs = 1;
+	size_t step = 10000;
+	size_t start = 10000;
+	size_t n_steps = 10;
+	size_t weight = 1;
+	EVAL_TYPE eval_type = LINEAR_SIZE;
+	size_t arena_mb = 0;
+	int huge_pages = 0;
+	int pin_workers = 0;
+	char* worker_list = NULL;
+	char* json_path = NULL;
+	char* baseline_path = NULL;
+	char* compare_path = NULL;
+	double threshold = COMPARE_THRESHOLD;
+	char* variant_list = NULL;
+	char* cost_list = NULL;
+
+	// Initialize arguments
+	processArgs(argc, argv, &eval_type, &runs, &step, &start, &n_steps, &weight, &arena_mb, &huge_pages, &pin_workers, &warmup_runs, &worker_list, &count_events, &json_path, &baseline_path, &compare_path, &threshold, &variant_list, &cost_list, &cost_mean);
+
+	// Comparing two result files runs nothing
+	if( baseline_path != NULL || compare_path != NULL ) {
+		if( baseline_path == NULL || compare_path == NULL ) {
+			fprintf(stderr, "Comparing needs both -B baseline.json and -R results.json\n");
+			return 2;
+		}
+		return compareResults(baseline_path, compare_path, threshold);
+	}
+
+	if( cost_mean < 1 ) {
+		fprintf(stderr, "The mean cost of the jobs (-m) must be at least 1\n");
+		return 2;
+	}
+
+	if( count_events && perf_events_init() == 0 ) {
+		fprintf(stderr, "Hardware counters are not available, only times are reported\n");
+		count_events = 0;
+	}
+
+	// Each worker count runs in its own process, the runtime of this one must not be started
+	if( eval_type == STRONG_SCALING || eval_type == WEAK ) {
+		if( eval_type == STRONG_SCALING )
+			strongScalingTester(runs, start, weight, worker_list, arena_mb, huge_pages, pin_workers);
+		else
+			weakScalingTester(runs, start, weight, worker_list, arena_mb, huge_pages, pin_workers);
+		return 0;
+	}
+
+	Scratch_Arena *arena = setupRuntime(arena_mb, huge_pages, pin_workers);
+
+	printf("runs=%lu \t warmup=%lu \t step=%lu \t start=%lu \t n_steps=%lu backend=%s workers=%d nodes=%d \n", runs, warmup_runs, step, start, n_steps, par_backend_name(), par_nworkers(), numa_count_nodes());
+
+	if( eval_type == NUMA_PLACEMENT || eval_type == ELEMENT_SIZE || eval_type == BANDWIDTH || eval_type == VARIANTS || eval_type == DATA_MOVEMENT || eval_type == LOAD_IMBALANCE ) {
+		if( eval_type == NUMA_PLACEMENT )
+			numaPlacementTester(runs, start, n_steps, step, weight);
+		else if( eval_type == ELEMENT_SIZE )
+			elementSizeTester(runs, start);
+		else if( eval_type == BANDWIDTH )
+			bandwidthTester(runs, start, n_steps, step);
+		else if( eval_type == VARIANTS )
+			variantTester(runs, start, n_steps, step, weight, variant_list);
+		else if( eval_type == DATA_MOVEMENT )
+			dataMovementTester(runs, start);
+		else
+			loadImbalanceTester(runs, start, weight, cost_list);
+		if (arena != NULL)
+			arena_destroy(arena);
+		return 0;
+	}
+
+	//size_t sizes = ((n_steps-start) / (double)step)+1;
+	Run_Stats*** results = createResultsMatrix(n_steps, nEvalFunctions);
+
+	if( eval_type == LINEAR_SIZE || eval_type == EXP_SIZE )
+		variableSizeTester(results, eval_type, runs, start, n_steps, step, weight);
+	else
+		variableWorkTest(results, eval_type, runs, start, n_steps, step, weight);
+
+	saveResults(results, step, start, n_steps, "./plots/%s-%s%s");
+	if( json_path != NULL )
+		saveJson(results, eval_type, runs, start, n_steps, step, weight, json_path);
+
+	freeResultsMatrix(results, n_steps, nEvalFunctions);
+
+	if (arena != NULL) {
+		printf("arena: high water %lu bytes, %lu overflows\n", arena_high_water(arena), arena_overflows(arena));
+		arena_destroy(arena);
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the parallel version of each pattern with its arrays placed by the workers that use them
+ * (first touch in par_for ranges) and with its arrays interleaved among the NUMA nodes.
+ */
+void numaPlacementTester(size_t runs, size_t start, size_t n_steps, size_t step, size_t weight) {
+
+	worker_weight = weight;
+
+	double (*results)[nEvalFunctions][2] = calloc(n_steps, sizeof(*results));
+
+	for(size_t i = 0; i < n_steps; i++) {
+		size_t current_size = i*step + start;
+
+		TYPE* src[2] = { numa_alloc_first_touch(current_size, sizeof(TYPE)), numa_alloc_interleave(current_size*sizeof(TYPE)) };
+		TYPE* dest[2] = { numa_alloc_first_touch(current_size, sizeof(TYPE)), numa_alloc_interleave(current_size*sizeof(TYPE)) };
+
+		// Writing the values does not move the pages of the first touch arrays
+		for (size_t j = 0; j < current_size; j++)
+			src[0][j] = src[1][j] = drand48();
+
+		for(size_t f = 0; f < nEvalFunctions; f++) {
+			for(size_t run = 0; run < runs; run++) {
+				for(size_t placement = 0; placement < 2; placement++) {
+					Run_Time t = evalFunction[f](src[placement], dest[placement], current_size, sizeof(TYPE), PAR);
+					printf("%s_%s %f microseconds\n", placement == 0 ? "local" : "interleaved", evalNames[f], t.wall);
+					results[i][f][placement] += t.wall / runs;
+				}
+			}
+		}
+
+		for (size_t placement = 0; placement < 2; placement++) {
+			numa_release(src[placement]);
+			numa_release(dest[placement]);
+		}
+	}
+
+	for(size_t f = 0; f < nEvalFunctions; f++) {
+		char fileName[strlen(evalNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-numa.csv", evalNames[f], par_backend_name());
+
+		FILE *fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+		fprintf (fp, ";%s;%s\n", "local", "interleaved");
+		for(size_t i = 0; i < n_steps; i++) {
+			fprintf (fp, "%lu;%f;%f\n", start+i*step, results[i][f][0], results[i][f][1]);
+			printf("%s \t size=%lu \t local %f us \t interleaved %f us\n", evalNames[f], start+i*step, results[i][f][0], results[i][f][1]);
+		}
+		fclose (fp);
+	}
+
+	free(results);
+}
+
+static const char *modeNames[MODES] = { "sequential", "parallel", "alternative", "alternative2" };
+
+static int compareDoubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+// Nearest rank percentile of n sorted samples
+static double percentile(const double *sorted, size_t n, double fraction) {
+	size_t rank = (size_t)ceil(fraction * n);
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ * Runs an eval function in a mode warmup_runs times untimed, then runs times, and summarizes the
+ * timed runs. The summary is not valid if the pattern does not implement the mode.
+ */
+static Run_Stats measureEval(EVALFUNCTION eval, const char *name, void *src, void *dest, size_t nJob, size_t sizeJob, MODE mode, size_t runs) {
+	Run_Stats stats = { 0 };
+	if (runs == 0)
+		return stats;
+
+	for (size_t run = 0; run < warmup_runs; run++)
+		if (eval(src, dest, nJob, sizeJob, mode).wall < 0)
+			return stats;
+
+	double *samples = malloc(runs * sizeof(double));
+	for (size_t run = 0; run < runs; run++) {
+		Perf_Group *group = count_events ? perf_begin() : NULL;
+		Run_Time t = eval(src, dest, nJob, sizeJob, mode);
+		double counts[PERF_EVENTS];
+		perf_end(group, counts);
+		if (t.wall < 0) {
+			free(samples);
+			return stats;
+		}
+		printf("%s_%s %f microseconds (cpu %f)\n", modeNames[mode], name, t.wall, t.cpu);
+
+		for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+			stats.events[event] += counts[event] / runs;
+
+		samples[run] = t.wall;
+		stats.mean += t.wall / runs;
+		stats.cpu += t.cpu / runs;
+	}
+
+	qsort(samples, runs, sizeof(double), compareDoubles);
+	stats.valid = 1;
+	stats.min = samples[0];
+	stats.median = runs % 2 == 1 ? samples[runs / 2] : (samples[runs / 2 - 1] + samples[runs / 2]) / 2;
+	stats.p95 = percentile(samples, runs, 0.95);
+	for (size_t run = 0; run < runs; run++)
+		stats.stddev += (samples[run] - stats.mean) * (samples[run] - stats.mean);
+	stats.stddev = runs > 1 ? sqrt(stats.stddev / (runs - 1)) : 0;
+
+	free(samples);
+
+	return stats;
+}
+
+// Runs a pattern of the main set on elements of TYPE
+static Run_Stats measure(size_t f, void *src, void *dest, size_t nJob, MODE mode, size_t runs) {
+	return measureEval(evalFunction[f], evalNames[f], src, dest, nJob, sizeof(TYPE), mode, runs);
+}
+
+// Speedup of the median of a mode over the median of the sequential version, 0 if unknown
+static double speedup(Run_Stats *modes, MODE mode) {
+	if (!modes[SEQ].valid || !modes[mode].valid || modes[mode].median <= 0)
+		return 0;
+	return modes[SEQ].median / modes[mode].median;
+}
+
+// Measures every pattern in every mode over the same arrays
+static void measureStep(Run_Stats **results, void *src, void *dest, size_t nJob, size_t runs) {
+	for(size_t f = 0; f < nEvalFunctions; f++)
+		for(MODE mode = SEQ; mode < MODES; mode++)
+			results[f][mode] = measure(f, src, dest, nJob, mode, runs);
+}
+
+// 1 if the event is counted in the runs
+static int countedEvent(Perf_Event event) {
+	return count_events && perf_event_available(event);
+}
+
+// Instructions per cycle of the runs, 0 if they were not counted
+static double instructionsPerCycle(const Run_Stats *stats) {
+	if (!countedEvent(PERF_CYCLES) || !countedEvent(PERF_INSTRUCTIONS) || stats->events[PERF_CYCLES] <= 0)
+		return 0;
+	return stats->events[PERF_INSTRUCTIONS] / stats->events[PERF_CYCLES];
+}
+
+// Hardware events of each mode of each pattern, per run
+static void printEvents(Run_Stats **results) {
+	printf("Pattern \t\t\t Mode \t\t");
+	for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+		if (countedEvent(event))
+			printf(" %s \t", perf_event_names[event]);
+	printf(" ipc\n");
+
+	for(size_t j = 0; j < nEvalFunctions; j++)
+		for(MODE mode = SEQ; mode < MODES; mode++) {
+			if (!results[j][mode].valid)
+				continue;
+			printf("%s \t\t\t %s \t", evalNames[j], modeNames[mode]);
+			for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+				if (countedEvent(event))
+					printf(" %.0f \t", results[j][mode].events[event]);
+			printf(" %.2f\n", instructionsPerCycle(&results[j][mode]));
+		}
+	printf("\n");
+}
+
+static void printSummary(Run_Stats **results) {
+	printf("Pattern \t\t\t Sequential \t Parallel \t Alternative \t Alternative2 \t (median, speedup)\n");
+	for(size_t j = 0; j < nEvalFunctions; j++){
+		printf("%s \t\t\t", evalNames[j]);
+		for(MODE mode = SEQ; mode < MODES; mode++) {
+			if (results[j][mode].valid)
+				printf(" %f us (%.2fx) \t", results[j][mode].median, speedup(results[j], mode));
+			else
+				printf(" - \t");
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	if (count_events)
+		printEvents(results);
+}
+
+void variableWorkTest(Run_Stats*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight) {
+
+	size_t current_size = start;
+	TYPE* src = createRandomArray(current_size);
+	TYPE* dest = malloc (current_size*sizeof(TYPE));
+
+	for(size_t i = 0; i < n_steps; i++) {
+		worker_weight = weight + i*step;
+		measureStep(results[i], src, dest, current_size, runs);
+	}
+
+	free(src);
+	free(dest);
+
+	for(size_t i = 0; i < n_steps; i++) {
+		printf("worker weight=%lu \t runs=%lu \t warmup=%lu\n", weight + i*step, runs, warmup_runs);
+		printSummary(results[i]);
+	}
+}
+
+// Name of the column of a mode of a pattern
+static const char *modeColumn(size_t pattern, MODE mode) {
+	if (mode == ALT)
+		return altNames[pattern];
+	if (mode == ALT2)
+		return alt2Names[pattern];
+	return modeNames[mode];
+}
+
+/*
+ * One file per pattern and backend, so that the backends can be compared. Each mode that the
+ * pattern implements has the columns min, median, p95, stddev, cpu and speedup, followed, when
+ * they are counted, by the hardware events per run and the instructions per cycle.
+ */
+void saveResults(Run_Stats*** results, size_t step, size_t start, size_t n_steps, char* filePattern) {
+
+	FILE * fp;
+
+	for( size_t pattern = 0; pattern < nEvalFunctions; pattern++) {
+		char fileName[strlen(filePattern)+strlen(evalNames[pattern])+strlen(par_backend_name())+4];
+		sprintf(fileName, filePattern, evalNames[pattern], par_backend_name(), ".csv");
+
+		fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+
+		for(MODE mode = SEQ; mode < MODES; mode++)
+			if(results[0][pattern][mode].valid) {
+				const char *name = modeColumn(pattern, mode);
+				fprintf (fp, ";%s_min;%s_median;%s_p95;%s_stddev;%s_cpu;%s_speedup", name, name, name, name, name, name);
+				for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+					if (countedEvent(event))
+						fprintf (fp, ";%s_%s", name, perf_event_names[event]);
+				if (count_events)
+					fprintf (fp, ";%s_ipc", name);
+			}
+		fprintf (fp, "\n");
+
+		for( size_t i = 0; i < n_steps; i++) {
+			fprintf (fp, "%lu", start+i*step);
+			for(MODE mode = SEQ; mode < MODES; mode++) {
+				if(!results[0][pattern][mode].valid)
+					continue;
+				Run_Stats *stats = &results[i][pattern][mode];
+				if(stats->valid)
+					fprintf (fp, ";%f;%f;%f;%f;%f;%f", stats->min, stats->median, stats->p95, stats->stddev, stats->cpu, speedup(results[i][pattern], mode));
+				else
+					fprintf (fp, ";;;;;;");
+				for (Perf_Event event = 0; event < PERF_EVENTS; event++)
+					if (countedEvent(event)) {
+						if (stats->valid)
+							fprintf (fp, ";%.0f", stats->events[event]);
+						else
+							fprintf (fp, ";");
+					}
+				if (count_events) {
+					if (stats->valid)
+						fprintf (fp, ";%f", instructionsPerCycle(stats));
+					else
+						fprintf (fp, ";");
+				}
+			}
+			fprintf (fp, "\n");
+		}
+
+		fclose (fp);
+	}
+}
+
+/*
+ * Opens a results file for writing, creating its directory if missing. Prints why and returns
+ * NULL if it cannot be opened.
+ */
+static FILE *openOutput(const char *fileName) {
+	char directory[strlen(fileName) + 1];
+	strcpy(directory, fileName);
+	if (mkdir(dirname(directory), 0755) != 0 && errno != EEXIST)
+		perror(directory);
+
+	FILE *fp = fopen (fileName, "w");
+	if (fp == NULL)
+		perror(fileName);
+	return fp;
+}
+
+// Writes a string as a JSON string
+static void writeJsonString(FILE *fp, const char *string) {
+	fputc('"', fp);
+	for (const char *c = string; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(fp, "\\%c", *c);
+		else if ((unsigned char)*c < 0x20)
+			fprintf(fp, "\\u%04x", *c);
+		else
+			fputc(*c, fp);
+	}
+	fputc('"', fp);
+}
+
+// Model name of the CPU, from /proc/cpuinfo
+static void readCpuModel(char *model, size_t size) {
+	snprintf(model, size, "unknown");
+
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+	if (fp == NULL)
+		return;
+
+	char line[512];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *value = strchr(line, ':');
+		if (strncmp(line, "model name", 10) != 0 || value == NULL)
+			continue;
+		value += value[1] == ' ' ? 2 : 1;
+		value[strcspn(value, "\n")] = '\0';
+		snprintf(model, size, "%s", value);
+		break;
+	}
+	fclose(fp);
+}
+
+/*
+ * Writes the results of a size or weight sweep to a JSON file, with the host and the settings
+ * they were taken with. Each result is an object on its own line:
+ *
+ *   {"pattern": "Map", "mode": "parallel", "size": 10000, "weight": 1, "min": ..., "median": ...}
+ *
+ * The times are in microseconds.
+ */
+void saveJson(Run_Stats*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight, const char* path) {
+	FILE *fp = openOutput(path);
+	if (fp == NULL)
+		return;
+
+	char hostname[256] = "unknown";
+	gethostname(hostname, sizeof(hostname) - 1);
+	char cpu[256];
+	readCpuModel(cpu, sizeof(cpu));
+	time_t now = time(NULL);
+	char date[64];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(fp, "{\n\"host\": {\"hostname\": ");
+	writeJsonString(fp, hostname);
+	fprintf(fp, ", \"cpu\": ");
+	writeJsonString(fp, cpu);
+	fprintf(fp, ", \"cpus\": %ld, \"nodes\": %d, \"backend\": \"%s\", \"workers\": %d, \"compiler\": ", sysconf(_SC_NPROCESSORS_ONLN), numa_count_nodes(), par_backend_name(), par_nworkers());
+	writeJsonString(fp, __VERSION__);
+	fprintf(fp, ", \"flags\": ");
+	writeJsonString(fp, BUILD_FLAGS);
+	fprintf(fp, ", \"date\": \"%s\"},\n", date);
+	fprintf(fp, "\"settings\": {\"eval_type\": %d, \"runs\": %lu, \"warmup\": %lu, \"start\": %lu, \"step\": %lu, \"n_steps\": %lu, \"weight\": %lu},\n", eval_type, runs, warmup_runs, start, step, n_steps, weight);
+	fprintf(fp, "\"results\": [");
+
+	int first = 1;
+	for(size_t i = 0; i < n_steps; i++) {
+		size_t size = eval_type == LINEAR_WEIGHT ? start : eval_type == EXP_SIZE ? powerFun(step, i) + start : i*step + start;
+		size_t current_weight = eval_type == LINEAR_WEIGHT ? weight + i*step : weight;
+
+		for(size_t f = 0; f < nEvalFunctions; f++)
+			for(MODE mode = SEQ; mode < MODES; mode++) {
+				Run_Stats *stats = &results[i][f][mode];
+				if (!stats->valid)
+					continue;
+				fprintf(fp, "%s\n{\"pattern\": \"%s\", \"mode\": \"%s\", \"size\": %lu, \"weight\": %lu, \"min\": %f, \"median\": %f, \"p95\": %f, \"mean\": %f, \"stddev\": %f, \"cpu\": %f}",
+						first ? "" : ",", evalNames[f], modeNames[mode], size, current_weight, stats->min, stats->median, stats->p95, stats->mean, stats->stddev, stats->cpu);
+				first = 0;
+			}
+	}
+	fprintf(fp, "\n]\n}\n");
+
+	fclose(fp);
+}
+
+/*
+ * One result of a JSON file of saveJson.
+ */
+typedef struct Saved_Result {
+	char pattern[64];
+	char mode[32];
+	size_t size;
+	size_t weight;
+	double median;
+} Saved_Result;
+
+// Copies the string value of a key of a result line, returns 0 if it is missing
+static int jsonString(const char *line, const char *key, char *value, size_t size) {
+	char pattern[64];
+	snprintf(pattern, sizeof(pattern), "\"%s\": \"", key);
+	const char *found = strstr(line, pattern);
+	if (found == NULL)
+		return 0;
+
+	found += strlen(pattern);
+	size_t length = strcspn(found, "\"");
+	if (length >= size)
+		length = size - 1;
+	memcpy(value, found, length);
+	value[length] = '\0';
+	return 1;
+}
+
+// Reads the number value of a key of a result line, returns 0 if it is missing
+static int jsonNumber(const char *line, const char *key, double *value) {
+	char pattern[64];
+	snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+	const char *found = strstr(line, pattern);
+	if (found == NULL)
+		return 0;
+
+	char *end;
+	*value = strtod(found + strlen(pattern), &end);
+	return end != found + strlen(pattern);
+}
+
+/*
+ * Reads the results of a JSON file of saveJson into a new array. Returns the # results, or -1 if
+ * the file cannot be read.
+ */
+static ssize_t readResults(const char *path, Saved_Result **results) {
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	size_t n = 0, capacity = 64;
+	*results = malloc(capacity * sizeof(Saved_Result));
+
+	char line[1024];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		Saved_Result result;
+		double size, weight;
+		if (!jsonString(line, "pattern", result.pattern, sizeof(result.pattern)) || !jsonString(line, "mode", result.mode, sizeof(result.mode))
+				|| !jsonNumber(line, "size", &size) || !jsonNumber(line, "weight", &weight) || !jsonNumber(line, "median", &result.median))
+			continue;
+		result.size = size;
+		result.weight = weight;
+
+		if (n == capacity) {
+			capacity *= 2;
+			*results = realloc(*results, capacity * sizeof(Saved_Result));
+		}
+		(*results)[n++] = result;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+/*
+ * Compares the medians of the results of two JSON files of saveJson, matched by pattern, mode,
+ * size and weight. A result regresses if its median grew by more than threshold percent.
+ * Returns 1 if some result regressed, 0 if none did, and 2 if a file cannot be read.
+ */
+int compareResults(const char* baseline_path, const char* compare_path, double threshold) {
+	Saved_Result *baseline, *results;
+	ssize_t n_baseline = readResults(baseline_path, &baseline);
+	if (n_baseline < 0)
+		return 2;
+	ssize_t n_results = readResults(compare_path, &results);
+	if (n_results < 0) {
+		free(baseline);
+		return 2;
+	}
+
+	size_t matched = 0, regressions = 0;
+	printf("Pattern \t Mode \t\t Size \t Weight \t Baseline \t Results \t Change\n");
+	for (ssize_t i = 0; i < n_results; i++) {
+		Saved_Result *result = &results[i];
+		Saved_Result *base = NULL;
+		for (ssize_t j = 0; j < n_baseline && base == NULL; j++)
+			if (strcmp(baseline[j].pattern, result->pattern) == 0 && strcmp(baseline[j].mode, result->mode) == 0
+					&& baseline[j].size == result->size && baseline[j].weight == result->weight)
+				base = &baseline[j];
+		if (base == NULL || base->median <= 0)
+			continue;
+
+		matched++;
+		double change = 100 * (result->median - base->median) / base->median;
+		int regressed = change > threshold;
+		regressions += regressed;
+		printf("%s \t %s \t %lu \t %lu \t %f us \t %f us \t %+.1f%%%s\n", result->pattern, result->mode, result->size, result->weight, base->median, result->median, change, regressed ? " REGRESSION" : "");
+	}
+
+	printf("\n%lu results compared, %lu regressed by more than %.1f%%\n", matched, regressions, threshold);
+	if (matched < n_results || matched < n_baseline)
+		printf("%ld results of %s and %ld of %s have no match\n", (long)(n_results - matched), compare_path, (long)(n_baseline - matched), baseline_path);
+
+	free(baseline);
+	free(results);
+
+	return regressions > 0;
+}
+
+/*
+ * Parses a list of worker counts ("1,2,4,8"). Without a list, the counts are the powers of two
+ * up to the # online CPUs, and the # CPUs itself. Returns the # counts.
+ */
+static size_t parseWorkerCounts(const char* worker_list, int* counts) {
+	size_t n = 0;
+
+	if (worker_list == NULL) {
+		int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		for (int count = 1; count < cpus && n < MAX_WORKER_COUNTS - 1; count *= 2)
+			counts[n++] = count;
+		counts[n++] = cpus > 0 ? cpus : 1;
+		return n;
+	}
+
+	const char *list = worker_list;
+	while (*list != '\0' && n < MAX_WORKER_COUNTS) {
+		char *end;
+		long count = strtol(list, &end, 10);
+		if (end == list)
+			break;
+		if (count > 0)
+			counts[n++] = count;
+		list = *end == ',' ? end + 1 : end;
+	}
+
+	return n;
+}
+
+/*
+ * Runs of every pattern at several worker counts. Each count runs in a child process that sets
+ * the # workers before the runtime starts, and leaves its results in shared memory.
+ */
+typedef struct Scaling_Sweep {
+	int counts[MAX_WORKER_COUNTS];
+	size_t n_counts;
+	Run_Stats *results;   // [count][pattern][mode], not valid until a child fills them in
+	size_t shared_size;
+} Scaling_Sweep;
+
+static Run_Stats *sweepStats(Scaling_Sweep *sweep, size_t c, size_t f, MODE mode) {
+	return &sweep->results[(c * nEvalFunctions + f) * MODES + mode];
+}
+
+/*
+ * Strong scaling times the parallel version on the same problem at each count, and the
+ * sequential version once, in the first child. Weak scaling grows the problem (size elements
+ * per worker) and the pipelines with the workers, and times all the parallel modes.
+ */
+static int runSweep(Scaling_Sweep *sweep, int weak, const char* worker_list, size_t runs, size_t size, size_t weight, size_t arena_mb, int huge_pages, int pin_workers) {
+	sweep->n_counts = parseWorkerCounts(worker_list, sweep->counts);
+	if (sweep->n_counts == 0) {
+		fprintf(stderr, "No worker counts in \"%s\"\n", worker_list);
+		return -1;
+	}
+
+	printf("%s scaling: size=%lu%s \t runs=%lu \t warmup=%lu \t backend=%s \t workers=", weak ? "weak" : "strong", size, weak ? " per worker" : "", runs, warmup_runs, par_backend_name());
+	for (size_t c = 0; c < sweep->n_counts; c++)
+		printf("%s%d", c == 0 ? "" : ",", sweep->counts[c]);
+	printf("\n");
+
+	sweep->shared_size = sweep->n_counts * nEvalFunctions * MODES * sizeof(Run_Stats);
+	sweep->results = mmap(NULL, sweep->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sweep->results == MAP_FAILED) {
+		perror("runSweep");
+		return -1;
+	}
+
+	for (size_t c = 0; c < sweep->n_counts; c++) {
+		int count = sweep->counts[c];
+
+		fflush(stdout);
+		pid_t child = fork();
+		if (child < 0) {
+			perror("fork");
+			break;
+		}
+
+		if (child == 0) {
+			if (par_set_nworkers(count) != 0)
+				fprintf(stderr, "Could not set %d workers\n", count);
+			Scratch_Arena *arena = setupRuntime(arena_mb, huge_pages, pin_workers);
+			printf("workers=%d (%d in the runtime)\n", count, par_nworkers());
+
+			size_t current_size = weak ? size * count : size;
+			worker_weight = weight;
+			weak_workers = weak ? count : 0;
+			TYPE* src = createRandomArray(current_size);
+			TYPE* dest = malloc (current_size*sizeof(TYPE));
+			for(size_t f = 0; f < nEvalFunctions; f++)
+				for(MODE mode = SEQ; mode < MODES; mode++)
+					if (weak ? mode != SEQ : mode == PAR || (mode == SEQ && c == 0))
+						*sweepStats(sweep, c, f, mode) = measure(f, src, dest, current_size, mode, runs);
+			free(src);
+			free(dest);
+
+			if (arena != NULL)
+				arena_destroy(arena);
+			fflush(stdout);
+			_exit(0);
+		}
+
+		int status;
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			fprintf(stderr, "The run with %d workers failed\n", count);
+	}
+
+	return 0;
+}
+
+/*
+ * Strong scaling: speedup over the sequential version, efficiency = speedup / workers, and the
+ * speedup over the parallel version at the first count.
+ */
+void strongScalingTester(size_t runs, size_t size, size_t weight, const char* worker_list, size_t arena_mb, int huge_pages, int pin_workers) {
+	Scaling_Sweep sweep;
+	if (runSweep(&sweep, 0, worker_list, runs, size, weight, arena_mb, huge_pages, pin_workers) != 0)
+		return;
+
+	for(size_t f = 0; f < nEvalFunctions; f++) {
+		Run_Stats *seq = sweepStats(&sweep, 0, f, SEQ);
+		Run_Stats *base = sweepStats(&sweep, 0, f, PAR);
+
+		char fileName[strlen(evalNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-scaling.csv", evalNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+		fprintf (fp, ";median;speedup;efficiency;relative_speedup\n");
+
+		printf("%s \t sequential %f us\n", evalNames[f], seq->valid ? seq->median : 0);
+		printf("Workers \t Parallel \t Speedup \t Efficiency \t Relative\n");
+		for (size_t c = 0; c < sweep.n_counts; c++) {
+			int count = sweep.counts[c];
+			Run_Stats *par = sweepStats(&sweep, c, f, PAR);
+			if (!par->valid || par->median <= 0) {
+				fprintf (fp, "%d;;;;\n", count);
+				printf("%d \t\t -\n", count);
+				continue;
+			}
+
+			double speedup = seq->valid ? seq->median / par->median : 0;
+			double relative = base->valid ? base->median / par->median : 0;
+			fprintf (fp, "%d;%f;%f;%f;%f\n", count, par->median, speedup, speedup / count, relative);
+			printf("%d \t\t %f us \t %.2fx \t\t %.2f \t\t %.2fx\n", count, par->median, speedup, speedup / count, relative);
+		}
+		printf("\n");
+		fclose (fp);
+	}
+
+	munmap(sweep.results, sweep.shared_size);
+}
+
+/*
+ * Weak scaling: for each parallel mode, the time at each count over the time at the first count,
+ * which stays at 1 when the patterns scale perfectly.
+ */
+void weakScalingTester(size_t runs, size_t size, size_t weight, const char* worker_list, size_t arena_mb, int huge_pages, int pin_workers) {
+	Scaling_Sweep sweep;
+	if (runSweep(&sweep, 1, worker_list, runs, size, weight, arena_mb, huge_pages, pin_workers) != 0)
+		return;
+
+	for(size_t f = 0; f < nEvalFunctions; f++) {
+		char fileName[strlen(evalNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-weak.csv", evalNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+
+		fprintf (fp, ";size");
+		printf("%s\nWorkers \t Size", evalNames[f]);
+		for(MODE mode = PAR; mode < MODES; mode++)
+			if (sweepStats(&sweep, 0, f, mode)->valid) {
+				fprintf (fp, ";%s_median;%s_ratio", modeColumn(f, mode), modeColumn(f, mode));
+				printf(" \t %s (ratio)", modeColumn(f, mode));
+			}
+		fprintf (fp, "\n");
+		printf("\n");
+
+		for (size_t c = 0; c < sweep.n_counts; c++) {
+			int count = sweep.counts[c];
+			fprintf (fp, "%d;%lu", count, size * count);
+			printf("%d \t\t %lu", count, size * count);
+
+			for(MODE mode = PAR; mode < MODES; mode++) {
+				Run_Stats *base = sweepStats(&sweep, 0, f, mode);
+				Run_Stats *stats = sweepStats(&sweep, c, f, mode);
+				if (!base->valid)
+					continue;
+				if (!stats->valid || base->median <= 0) {
+					fprintf (fp, ";;");
+					printf(" \t -");
+					continue;
+				}
+				fprintf (fp, ";%f;%f", stats->median, stats->median / base->median);
+				printf(" \t %f us (%.2f)", stats->median, stats->median / base->median);
+			}
+			fprintf (fp, "\n");
+			printf("\n");
+		}
+		printf("\n");
+		fclose (fp);
+	}
+
+	munmap(sweep.results, sweep.shared_size);
+}
+
+/*
+ * Runs the patterns of the sized set on nJob elements of each element type, and reports the
+ * throughput of each mode in elements and in GB of source elements per second.
+ */
+void elementSizeTester(size_t runs, size_t nJob) {
+	Run_Stats (*results)[nSizedFunctions][2] = calloc(nElementTypes, sizeof(*results));
+
+	for(size_t t = 0; t < nElementTypes; t++) {
+		element_type = &elementTypes[t];
+
+		void *src = malloc(nJob * element_type->size);
+		void *dest = malloc(nJob * element_type->size);
+		for (size_t i = 0; i < nJob; i++)
+			element_type->fill(src + i * element_type->size);
+
+		for(size_t f = 0; f < nSizedFunctions; f++)
+			for(MODE mode = SEQ; mode <= PAR; mode++)
+				results[t][f][mode] = measureEval(sizedFunction[f], sizedNames[f], src, dest, nJob, element_type->size, mode, runs);
+
+		free(src);
+		free(dest);
+	}
+
+	for(size_t f = 0; f < nSizedFunctions; f++) {
+		char fileName[strlen(sizedNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-elements.csv", sizedNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+		fprintf (fp, "type;bytes");
+		for(MODE mode = SEQ; mode <= PAR; mode++)
+			fprintf (fp, ";%s_median;%s_elements_s;%s_gb_s", modeNames[mode], modeNames[mode], modeNames[mode]);
+		fprintf (fp, "\n");
+
+		printf("%s \t elements=%lu\nType \t\t Bytes \t Sequential \t\t\t Parallel \t\t\t (elements/s, GB/s)\n", sizedNames[f], nJob);
+		for(size_t t = 0; t < nElementTypes; t++) {
+			fprintf (fp, "%s;%lu", elementTypes[t].name, elementTypes[t].size);
+			printf("%s \t %lu", elementTypes[t].name, elementTypes[t].size);
+
+			for(MODE mode = SEQ; mode <= PAR; mode++) {
+				Run_Stats *stats = &results[t][f][mode];
+				if (!stats->valid || stats->median <= 0) {
+					fprintf (fp, ";;;");
+					printf(" \t -");
+					continue;
+				}
+				double elements = nJob / (stats->median / 1e6);
+				double gigabytes = elements * elementTypes[t].size / 1e9;
+				fprintf (fp, ";%f;%f;%f", stats->median, elements, gigabytes);
+				printf(" \t %.3e el/s %.3f GB/s", elements, gigabytes);
+			}
+			fprintf (fp, "\n");
+			printf("\n");
+		}
+		printf("\n");
+		fclose (fp);
+	}
+
+	free(results);
+}
+
+/*
+ * Runs the patterns of the sized set with the light workers on doubles, at each size, and
+ * reports the bandwidth of each mode, from the bytes each pattern has to move, in GB/s and in
+ * percent of the peak bandwidth that the STREAM kernels reach.
+ */
+void bandwidthTester(size_t runs, size_t start, size_t n_steps, size_t step) {
+	double peak = measurePeakBandwidth();
+	printf("peak bandwidth %f GB/s\n\n", peak);
+
+	element_type = &elementTypes[2];   // double
+	Run_Stats (*results)[nSizedFunctions][2] = calloc(n_steps, sizeof(*results));
+
+	for(size_t i = 0; i < n_steps; i++) {
+		size_t current_size = i*step + start;
+		TYPE* src = createRandomArray(current_size);
+		TYPE* dest = malloc (current_size*sizeof(TYPE));
+
+		for(size_t f = 0; f < nSizedFunctions; f++)
+			for(MODE mode = SEQ; mode <= PAR; mode++)
+				results[i][f][mode] = measureEval(sizedFunction[f], sizedNames[f], src, dest, current_size, sizeof(TYPE), mode, runs);
+
+		free(src);
+		free(dest);
+	}
+
+	for(size_t f = 0; f < nSizedFunctions; f++) {
+		char fileName[strlen(sizedNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-bandwidth.csv", sizedNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp == NULL)
+			continue;
+		fprintf (fp, ";bytes");
+		for(MODE mode = SEQ; mode <= PAR; mode++)
+			fprintf (fp, ";%s_median;%s_gb_s;%s_peak_percent", modeNames[mode], modeNames[mode], modeNames[mode]);
+		fprintf (fp, "\n");
+
+		printf("%s \t peak %f GB/s\nSize \t\t Bytes \t\t Sequential \t\t Parallel \t\t (GB/s, %% of peak)\n", sizedNames[f], peak);
+		for(size_t i = 0; i < n_steps; i++) {
+			size_t current_size = i*step + start;
+			double bytes = sizedBytes(f, current_size, sizeof(TYPE));
+			fprintf (fp, "%lu;%.0f", current_size, bytes);
+			printf("%lu \t %.0f", current_size, bytes);
+
+			for(MODE mode = SEQ; mode <= PAR; mode++) {
+				Run_Stats *stats = &results[i][f][mode];
+				if (!stats->valid || stats->median <= 0) {
+					fprintf (fp, ";;;");
+					printf(" \t -");
+					continue;
+				}
+				double bandwidth = bytes / (stats->median * 1e3);
+				double percent = peak > 0 ? 100 * bandwidth / peak : 0;
+				fprintf (fp, ";%f;%f;%f", stats->median, bandwidth, percent);
+				printf(" \t %.3f GB/s %.1f%%", bandwidth, percent);
+			}
+			fprintf (fp, "\n");
+			printf("\n");
+		}
+		printf("\n");
+		fclose (fp);
+	}
+
+	free(results);
+}
+
+// 1 if name is in a comma separated list of names, or if there is no list
+static int listedName(const char *list, const char *name) {
+	if (list == NULL)
+		return 1;
+
+	size_t length = strlen(name);
+	for (const char *entry = list; *entry != '\0'; ) {
+		size_t entry_length = strcspn(entry, ",");
+		if (entry_length == length && strncmp(entry, name, length) == 0)
+			return 1;
+		entry += entry[entry_length] == ',' ? entry_length + 1 : entry_length;
+	}
+	return 0;
+}
+
+/*
+ * Runs every registered variant of each pattern, or those named in variant_list, at each size,
+ * and reports their median and their speedup over the sequential version of the pattern.
+ */
+void variantTester(size_t runs, size_t start, size_t n_steps, size_t step, size_t weight, const char* variant_list) {
+	worker_weight = weight;
+
+	for (variant_pattern = 0; variant_pattern < VARIANT_PATTERNS; variant_pattern++) {
+		const char *pattern = variant_pattern_name(variant_pattern);
+		size_t n_variants = variant_count(variant_pattern);
+
+		int listed[VARIANTS_MAX];
+		size_t n_listed = 0;
+		for (size_t v = 0; v < n_variants; v++) {
+			listed[v] = listedName(variant_list, variant_name(variant_pattern, v));
+			n_listed += listed[v];
+		}
+		if (n_listed == 0)
+			continue;
+
+		// Column 0 is the sequential version, column v + 1 the variant v
+		Run_Stats (*results)[VARIANTS_MAX + 1] = calloc(n_steps, sizeof(*results));
+
+		for(size_t i = 0; i < n_steps; i++) {
+			size_t current_size = i*step + start;
+			TYPE* src = createRandomArray(current_size);
+			TYPE* dest = malloc (current_size*sizeof(TYPE));
+
+			variant_index = 0;
+			results[i][0] = measureEval(evalVariant, pattern, src, dest, current_size, sizeof(TYPE), SEQ, runs);
+			for (variant_index = 0; variant_index < n_variants; variant_index++)
+				if (listed[variant_index])
+					results[i][variant_index + 1] = measureEval(evalVariant, variant_name(variant_pattern, variant_index), src, dest, current_size, sizeof(TYPE), PAR, runs);
+
+			free(src);
+			free(dest);
+		}
+
+		char fileName[strlen(pattern)+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-variants.csv", pattern, par_backend_name());
+		FILE *fp = openOutput (fileName);
+
+		printf("%s \t (median, speedup)\nSize \t\t sequential", pattern);
+		if (fp != NULL)
+			fprintf (fp, ";sequential_median");
+		for (size_t v = 0; v < n_variants; v++)
+			if (listed[v]) {
+				const char *name = variant_name(variant_pattern, v);
+				printf(" \t %s", name);
+				if (fp != NULL)
+					fprintf (fp, ";%s_median;%s_speedup", name, name);
+			}
+		printf("\n");
+		if (fp != NULL)
+			fprintf (fp, "\n");
+
+		for(size_t i = 0; i < n_steps; i++) {
+			Run_Stats *seq = &results[i][0];
+			printf("%lu \t %f us", i*step + start, seq->median);
+			if (fp != NULL)
+				fprintf (fp, "%lu;%f", i*step + start, seq->median);
+
+			for (size_t v = 0; v < n_variants; v++) {
+				Run_Stats *stats = &results[i][v + 1];
+				if (!listed[v])
+					continue;
+				double speedup = stats->valid && stats->median > 0 ? seq->median / stats->median : 0;
+				printf(" \t %f us (%.2fx)", stats->median, speedup);
+				if (fp != NULL)
+					fprintf (fp, ";%f;%f", stats->median, speedup);
+			}
+			printf("\n");
+			if (fp != NULL)
+				fprintf (fp, "\n");
+		}
+		printf("\n");
+
+		if (fp != NULL)
+			fclose (fp);
+		free(results);
+	}
+}
+
+// Selectivities of the filters of pack and split in the data movement sweep
+static const double selectivities[] = { 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999 };
+
+// Index of a pattern of the sized set
+static size_t sizedIndex(const char *name) {
+	size_t f = 0;
+	while (f < nSizedFunctions && strcmp(sizedNames[f], name) != 0)
+		f++;
+	assert (f < nSizedFunctions);
+	return f;
+}
+
+/*
+ * Measures a pattern of the sized set on doubles, sequentially and in parallel, and writes a row
+ * of its median, speedup and parallel throughput.
+ */
+static void measureDataMovement(FILE *fp, const char *setting, size_t f, void *src, void *dest, size_t nJob, size_t runs) {
+	Run_Stats seq = measureEval(sizedFunction[f], sizedNames[f], src, dest, nJob, sizeof(TYPE), SEQ, runs);
+	Run_Stats par = measureEval(sizedFunction[f], sizedNames[f], src, dest, nJob, sizeof(TYPE), PAR, runs);
+
+	double speedup = seq.valid && par.valid && par.median > 0 ? seq.median / par.median : 0;
+	double elements = par.valid && par.median > 0 ? nJob / (par.median / 1e6) : 0;
+
+	printf("%s \t %s \t\t %f us \t %f us \t %.2fx \t %.3e el/s\n", sizedNames[f], setting, seq.median, par.median, speedup, elements);
+	if (fp != NULL)
+		fprintf (fp, "%s;%f;%f;%f;%f\n", setting, seq.median, par.median, speedup, elements);
+}
+
+/*
+ * Runs pack and split on nJob doubles at each filter selectivity, and gather and scatter with
+ * each distribution of indices, to see where the performance of each pattern falls off.
+ */
+void dataMovementTester(size_t runs, size_t nJob) {
+	element_type = &elementTypes[2];   // double
+	TYPE* src = createRandomArray(nJob);
+	TYPE* dest = malloc (nJob*sizeof(TYPE));
+
+	const char *filtered[] = { "Pack", "Split" };
+	for (size_t p = 0; p < sizeof(filtered)/sizeof(filtered[0]); p++) {
+		size_t f = sizedIndex(filtered[p]);
+		char fileName[strlen(sizedNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-selectivity.csv", sizedNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp != NULL)
+			fprintf (fp, "selectivity;sequential_median;parallel_median;speedup;elements_s\n");
+
+		printf("Pattern \t Selectivity \t Sequential \t Parallel \t Speedup \t Parallel throughput\n");
+		for (size_t i = 0; i < sizeof(selectivities)/sizeof(selectivities[0]); i++) {
+			char setting[32];
+			snprintf(setting, sizeof(setting), "%g", selectivities[i]);
+			filter_selectivity = selectivities[i];
+			measureDataMovement(fp, setting, f, src, dest, nJob, runs);
+		}
+		printf("\n");
+
+		if (fp != NULL)
+			fclose (fp);
+	}
+	filter_selectivity = 0.5;
+
+	const char *indexed[] = { "Gather", "Scatter" };
+	for (size_t p = 0; p < sizeof(indexed)/sizeof(indexed[0]); p++) {
+		size_t f = sizedIndex(indexed[p]);
+		char fileName[strlen(sizedNames[f])+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-indices.csv", sizedNames[f], par_backend_name());
+		FILE *fp = openOutput (fileName);
+		if (fp != NULL)
+			fprintf (fp, "distribution;sequential_median;parallel_median;speedup;elements_s\n");
+
+		printf("Pattern \t Indices \t Sequential \t Parallel \t Speedup \t Parallel throughput\n");
+		for (index_distribution = 0; index_distribution < INDEX_DISTRIBUTIONS; index_distribution++)
+			measureDataMovement(fp, indexDistributionNames[index_distribution], f, src, dest, nJob, runs);
+		printf("\n");
+
+		if (fp != NULL)
+			fclose (fp);
+	}
+	index_distribution = INDEX_UNIFORM;
+
+	free(src);
+	free(dest);
+}
+
+// Distributions of the cost of each job in the load imbalance sweep
+typedef enum Cost_Distribution {
+	COST_BALANCED,        // Every job costs the mean
+	COST_UNIFORM,         // Uniform between 1 and about 2*mean-1
+	COST_BIMODAL,         // Mostly cheap jobs, and a few very expensive ones
+	COST_HEAVY_TAILED,    // Pareto distributed
+	COST_POSITION,        // Growing linearly with the position of the job
+	COST_DISTRIBUTIONS
+} Cost_Distribution;
+
+static const char *costDistributionNames[COST_DISTRIBUTIONS] = { "balanced", "uniform", "bimodal", "heavy_tailed", "position" };
+
+// Fraction of the expensive jobs of the bimodal distribution; the others cost 1
+#define COST_BIMODAL_FRACTION 0.1
+
+// Shape of the Pareto distribution of the heavy tailed costs, and how many times the mean they
+// are cut at
+#define COST_PARETO_ALPHA 1.5
+#define COST_MAX_RATIO 256
+
+// Cost ratio of the middle stage to the others in the pipeline stage sweep
+static const size_t stageSkews[] = { 1, 2, 4, 8, 16 };
+
+// Cost ratio of the middle stage of the pipelines of the load imbalance sweep
+static size_t stage_skew = 1;
+
+/*
+ * Array of the costs of size jobs, drawn from a distribution whose mean is about mean (the costs
+ * are whole calls of workerHeavy). The cost of a job is its value, so the workers of the patterns
+ * find it in their input.
+ */
+static TYPE *createCosts(size_t size, Cost_Distribution distribution, double mean) {
+	TYPE *costs = malloc(size * sizeof(*costs));
+	assert (costs != NULL);
+
+	double high = round(1 + (mean - 1) / COST_BIMODAL_FRACTION);
+	double scale = mean * (COST_PARETO_ALPHA - 1) / COST_PARETO_ALPHA;
+	double max = round(COST_MAX_RATIO * mean);
+	for (size_t i = 0; i < size; i++) {
+		double cost = round(mean);
+		switch (distribution) {
+		case COST_UNIFORM:
+			cost = 1 + floor(drand48() * (2 * mean - 1));
+			break;
+		case COST_BIMODAL:
+			cost = drand48() < COST_BIMODAL_FRACTION ? high : 1;
+			break;
+		case COST_HEAVY_TAILED:
+			cost = round(scale / pow(1 - drand48(), 1 / COST_PARETO_ALPHA));
+			cost = cost < 1 ? 1 : cost > max ? max : cost;
+			break;
+		case COST_POSITION:
+			cost = size > 1 ? 1 + round((2 * mean - 2) * i / (size - 1)) : round(mean);
+			break;
+		default:
+			break;
+		}
+		costs[i] = cost;
+	}
+
+	return costs;
+}
+
+static void workerCosted(void* a, const void* b) {
+	// As many times the cost of workerHeavy as the value of b, which is passed on to a
+	TYPE cost = b == NULL ? 1 : *(TYPE *)b;
+	for(size_t i = 0; i < (size_t)cost; i++)
+		workerHeavy(a, b);
+	*(TYPE *)a = cost;
+}
+
+static void workerCostedSkewed(void* a, const void* b) {
+	// stage_skew times the cost of workerCosted
+	for(size_t i = 0; i < stage_skew; i++)
+		workerCosted(a, b);
+}
+
+Run_Time evalCostedMap(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		map_seq (dest, src, nJob, size, workerCosted);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		map (dest, src, nJob, size, workerCosted);
+		elapsed = timerStop(&timer);
+	} else {
+		return NO_RUN;
+	}
+
+	return elapsed;
+}
+
+Run_Time evalCostedFarm(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// One farm worker per worker of the backend, in static blocks or one job at a time
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		farm_seq (dest, src, nJob, size, workerCosted, par_nworkers());
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		farm (dest, src, nJob, size, workerCosted, par_nworkers());
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		farm_dynamic (dest, src, nJob, size, workerCosted, par_nworkers(), 1);
+		elapsed = timerStop(&timer);
+	} else {
+		return NO_RUN;
+	}
+
+	return elapsed;
+}
+
+Run_Time evalCostedPipeline(void* src, void* dest, size_t nJob, size_t size, MODE mode) {
+	// Three stages of the cost of each job, the middle one stage_skew times as expensive
+	void (*pipelineFunction[])(void*, const void*) = {
+			workerCosted,
+			workerCostedSkewed,
+			workerCosted
+	};
+	int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+
+	Run_Timer timer;
+	Run_Time elapsed = NO_RUN;
+
+	if( mode == SEQ) {
+		timerStart(&timer);
+		pipeline_seq (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else if (mode == PAR) {
+		timerStart(&timer);
+		pipeline (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else if (mode == ALT) {
+		timerStart(&timer);
+		pipeline_async (dest, src, nJob, size, pipelineFunction, nPipelineFunction);
+		elapsed = timerStop(&timer);
+	} else {
+		return NO_RUN;
+	}
+
+	return elapsed;
+}
+
+// A pattern of the load imbalance sweep, and the name of what it runs in each mode
+typedef struct Imbalance_Pattern {
+	const char *name;
+	EVALFUNCTION eval;
+	const char *modes[MODES];  // NULL for the modes it does not implement
+} Imbalance_Pattern;
+
+static const Imbalance_Pattern imbalancePatterns[] = {
+	{ "Map", evalCostedMap, { "map_seq", "map", NULL, NULL } },
+	{ "Farm", evalCostedFarm, { "farm_seq", "farm", "farm_dynamic", NULL } },
+	{ "Pipeline", evalCostedPipeline, { "pipeline_seq", "pipeline", "pipeline_async", NULL } }
+};
+
+/*
+ * Measures a pattern of the load imbalance sweep in every mode, and writes a row per parallel
+ * mode of its median against the ideal balanced time: the sequential median split evenly among
+ * the workers. The imbalance is how many times the ideal time the mode takes.
+ */
+static void measureImbalance(FILE *fp, const char *setting, const Imbalance_Pattern *pattern, void *src, void *dest, size_t nJob, size_t runs) {
+	Run_Stats seq = measureEval(pattern->eval, pattern->name, src, dest, nJob, sizeof(TYPE), SEQ, runs);
+	double ideal = seq.valid ? seq.median / par_nworkers() : 0;
+
+	for (MODE mode = PAR; mode < MODES; mode++) {
+		if (pattern->modes[mode] == NULL)
+			continue;
+
+		Run_Stats par = measureEval(pattern->eval, pattern->name, src, dest, nJob, sizeof(TYPE), mode, runs);
+		double imbalance = par.valid && ideal > 0 ? par.median / ideal : 0;
+
+		printf("%s \t %s \t %f us \t %f us \t %f us \t %.2fx\n", pattern->modes[mode], setting, seq.median, par.median, ideal, imbalance);
+		if (fp != NULL)
+			fprintf (fp, "%s;%s;%f;%f;%f;%f\n", setting, pattern->modes[mode], seq.median, par.median, ideal, imbalance);
+	}
+}
+
+/*
+ * Runs map, farm and pipeline on nJob jobs whose costs follow each distribution (or those named
+ * in cost_list), and the pipeline with balanced jobs and its middle stage more and more
+ * expensive, to see how far each way of splitting the work falls from the ideal balanced time.
+ */
+void loadImbalanceTester(size_t runs, size_t nJob, size_t weight, const char* cost_list) {
+	worker_weight = weight;
+	TYPE* dest = malloc (nJob*sizeof(TYPE));
+	size_t nPatterns = sizeof(imbalancePatterns)/sizeof(imbalancePatterns[0]);
+
+	FILE *fps[nPatterns];
+	for (size_t p = 0; p < nPatterns; p++) {
+		char fileName[strlen(imbalancePatterns[p].name)+strlen(par_backend_name())+32];
+		sprintf(fileName, "./plots/%s-%s-imbalance.csv", imbalancePatterns[p].name, par_backend_name());
+		fps[p] = openOutput (fileName);
+		if (fps[p] != NULL)
+			fprintf (fps[p], "distribution;variant;sequential_median;median;ideal;imbalance\n");
+	}
+
+	printf("Variant \t Costs (mean %g) \t Sequential \t Parallel \t Ideal \t Imbalance\n", cost_mean);
+	for (Cost_Distribution distribution = 0; distribution < COST_DISTRIBUTIONS; distribution++) {
+		if (!listedName(cost_list, costDistributionNames[distribution]))
+			continue;
+		TYPE* src = createCosts(nJob, distribution, cost_mean);
+		for (size_t p = 0; p < nPatterns; p++)
+			measureImbalance(fps[p], costDistributionNames[distribution], &imbalancePatterns[p], src, dest, nJob, runs);
+		free(src);
+	}
+	printf("\n");
+
+	for (size_t p = 0; p < nPatterns; p++)
+		if (fps[p] != NULL)
+			fclose (fps[p]);
+
+	const Imbalance_Pattern *pipelinePattern = &imbalancePatterns[nPatterns - 1];
+	char fileName[strlen(par_backend_name())+32];
+	sprintf(fileName, "./plots/Pipeline-%s-stages.csv", par_backend_name());
+	FILE *fp = openOutput (fileName);
+	if (fp != NULL)
+		fprintf (fp, "skew;variant;sequential_median;median;ideal;imbalance\n");
+
+	TYPE* src = createCosts(nJob, COST_BALANCED, cost_mean);
+	printf("Variant \t Stage skew \t Sequential \t Parallel \t Ideal \t Imbalance\n");
+	for (size_t i = 0; i < sizeof(stageSkews)/sizeof(stageSkews[0]); i++) {
+		char setting[32];
+		snprintf(setting, sizeof(setting), "%lu", stageSkews[i]);
+		stage_skew = stageSkews[i];
+		measureImbalance(fp, setting, pipelinePattern, src, dest, nJob, runs);
+	}
+	printf("\n");
+	stage_skew = 1;
+
+	if (fp != NULL)
+		fclose (fp);
+
+	free(src);
+	free(dest);
+}
+
+/*void producePlotScript(char* filePattern, char* patternName, ) {
+
+}*/
+
+static void processArgs(int argc, char** argv, EVAL_TYPE* eval_type, size_t* runs, size_t* step, size_t* start, size_t* n_steps, size_t* weight, size_t* arena_mb, int* huge_pages, int* pin_workers, size_t* warmup, char** worker_list, int* count_events, char** json_path, char** baseline_path, char** compare_path, double* threshold, char** variant_list, char** cost_list, double* mean) {
+	int c;
+
+	opterr = 0;
+
+	while ((c = getopt(argc, argv, "r:s:i:n:t:w:a:u:W:j:B:R:T:V:c:m:HPC")) != -1)
+		switch (c) {
+		case 'V':
+			*variant_list = optarg;
+			break;
+		case 'c':
+			*cost_list = optarg;
+			break;
+		case 'm':
+			*mean = strtod (optarg, NULL);
+			break;
+		case 'j':
+			*json_path = optarg;
+			break;
+		case 'B':
+			*baseline_path = optarg;
+			break;
+		case 'R':
+			*compare_path = optarg;
+			break;
+		case 'T':
+			*threshold = strtod (optarg, NULL);
+			break;
+		case 'C':
+			*count_events = 1;
+			break;
+		case 'P':
+			*pin_workers = 1;
+			break;
+		case 'u':
+			*warmup = strtol (optarg, NULL, 10);
+			break;
+		case 'W':
+			*worker_list = optarg;
+			break;
+		case 'a':
+			*arena_mb = strtol (optarg, NULL, 10);
+			break;
+		case 'H':
+			*huge_pages = 1;
+			break;
+		case 't':
+			*eval_type = strtol (optarg, NULL, 10);
+			break;
+		case 'w':
+			*weight = strtol (optarg, NULL, 10);
+			break;
+		case 'r':
 			*runs = strtol (optarg, NULL, 10);
 			break;
 		case 's':
@@ -564,7 +2814,7 @@ static void processArgs(int argc, char** argv, EVAL_TYPE* eval_type, size_t* run
 			*n_steps = strtol (optarg, NULL, 10);
 			break;
 		case '?':
-			if (optopt == 'r' || optopt == 's' || optopt == 'i' || optopt == 'n' || optopt == 't' || optopt == 'w' )
+			if (optopt == 'r' || optopt == 's' || optopt == 'i' || optopt == 'n' || optopt == 't' || optopt == 'w' || optopt == 'a' || optopt == 'u' || optopt == 'W' || optopt == 'j' || optopt == 'B' || optopt == 'R' || optopt == 'T' || optopt == 'V' || optopt == 'c' || optopt == 'm' )
 				fprintf(stderr, "Option -%c is followed a the number.\n", optopt);
 			/*else if (isprint(optopt))
 				fprintf(stderr, "Unknown option `-%c'.\n", optopt);*/
@@ -583,29 +2833,28 @@ size_t powerFun(size_t base, size_t exp) {
 	return (size_t)pow((double)base, (double)exp);
 }
 
-double*** createResultsMatrix(size_t n_steps, size_t functions) {
-	double*** results = malloc( n_steps*sizeof(double**) );
+Run_Stats*** createResultsMatrix(size_t n_steps, size_t functions) {
+	Run_Stats*** results = malloc( n_steps*sizeof(Run_Stats**) );
 
 	for(size_t i = 0; i < n_steps; i++){
-		results[i] = malloc( functions*sizeof(double*) );
-		for(size_t j = 0; j < functions; j++) {
-			results[i][j] = malloc(MODES*sizeof(double));
-			bzero(results[i][j], MODES*sizeof(double));
-		}
+		results[i] = malloc( functions*sizeof(Run_Stats*) );
+		for(size_t j = 0; j < functions; j++)
+			results[i][j] = calloc(MODES, sizeof(Run_Stats));
 	}
 	return results;
 }
 
-void freeResultsMatrix(double*** results, size_t n_steps, size_t functions) {
+void freeResultsMatrix(Run_Stats*** results, size_t n_steps, size_t functions) {
 	for(size_t i = 0; i < n_steps; i++){
 		for(size_t j = 0; j < functions; j++) {
 			free(results[i][j]);
 		}
 		free(results[i]);
 	}
+	free(results);
 }
 
-void variableSizeTester(double*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight) {
+void variableSizeTester(Run_Stats*** results, EVAL_TYPE eval_type, size_t runs, size_t start, size_t n_steps, size_t step, size_t weight) {
 
 	worker_weight = weight;
 
@@ -615,62 +2864,23 @@ void variableSizeTester(double*** results, EVAL_TYPE eval_type, size_t runs, siz
 			current_size = powerFun(step, i) + start;
 		else
 			current_size = i*step + start;
-		//printf("Current_size: %lu\n", current_size);
 
 		TYPE* src = createRandomArray(current_size);
 		TYPE* dest = malloc (current_size*sizeof(TYPE));
 
-		for(size_t f = 0; f < nEvalFunctions; f++) {
-			//printf("Current pattern: %s\n", evalNames[f]);
-			for(size_t run = 0; run < runs; run++) {
-				// printf("Size=%lu \t pattern=%s \t run=%lu/%lu \n", current_size, evalNames[f], run+1, runs);
+		measureStep(results[i], src, dest, current_size, runs);
 
-				// Parallel
-				unsigned long t;
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), PAR);
-				printf("parallel_%s %lu microseconds\n", evalNames[f], t);
-
-				results[i][f][PAR] += t;
-
-				// Seq
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), SEQ);
-				printf("sequential_%s %lu microseconds\n", evalNames[f], t);
-
-				results[i][f][SEQ] += t;
-
-				// Alternative
-				t = evalFunction[f](src, dest, current_size, sizeof(TYPE), ALT);
-				printf("sequential_%s %lu microseconds\n", evalNames[f], t);
-
-				results[i][f][ALT] += t;
-			}
-		}
 		free(src);
 		free(dest);
 	}
 
-	// Compute the average between the different runs
-	if( runs >= 1 ) {
-		for(size_t i = 0; i < n_steps; i++) {
-			size_t current_size;
-			if( eval_type == EXP_SIZE)
-				current_size = powerFun(step, i) + start;
-			else
-				current_size = i*step + start;
-			printf("array size=%lu \t runs=%lu\n", current_size, runs );
-			printf("Pattern \t\t\t Sequential 	\t Parallel \t Parallel2\n");
-			for(size_t j = 0; j < nEvalFunctions; j++){
-				for(size_t k = 0; k < 2; k++){
-					results[i][j][k] = results[i][j][k] / runs;
-				}
-
-				printf("%s \t\t\t %f us \t %f us", evalNames[j], results[i][j][SEQ], results[i][j][PAR]);
-				if( results[i][j][PAR] > 0 ) {
-					printf( "\t %f us", results[i][j][PAR]);
-				}
-				printf("\n");
-			}
-			printf("\n");
-		}
+	for(size_t i = 0; i < n_steps; i++) {
+		size_t current_size;
+		if( eval_type == EXP_SIZE)
+			current_size = powerFun(step, i) + start;
+		else
+			current_size = i*step + start;
+		printf("array size=%lu \t runs=%lu \t warmup=%lu\n", current_size, runs, warmup_runs);
+		printSummary(results[i]);
 	}
 }
@@ -5,6 +5,14 @@
 #include <stdio.h>
 
 #include "patterns.h"
+#include "persistent_farm.h"
+#include "patterns_typed.h"
+#include "arena.h"
+#include "chain.h"
+#include "patterns_async.h"
+#include "file_patterns.h"
+#include "variants.h"
+#include "parallel.h"
 #include "debug.h"
 #include "unit.h"
 
@@ -78,6 +86,24 @@ static void workerMultTwo(void* a, const void* b) {
     *(TYPE *)a = res_b * 2;
 }
 
+typedef struct Pair {
+    TYPE value;
+    TYPE twice;
+} Pair;
+
+static void workerToPair(void* a, const void* b) {
+    TYPE res_b = b == NULL ? SUM_NEUTRAL : *(TYPE *)b;
+
+    // a = (b, b * 2)
+    ((Pair *)a)->value = res_b;
+    ((Pair *)a)->twice = res_b * 2;
+}
+
+static void workerPairSum(void* a, const void* b) {
+    // a = b.value + b.twice
+    *(TYPE *)a = ((Pair *)b)->value + ((Pair *)b)->twice;
+}
+
 static void workerDivTwo(void* a, const void* b) {
     TYPE res_b = b == NULL ? MULT_NEUTRAL : *(TYPE *)b;
 	
@@ -85,6 +111,32 @@ static void workerDivTwo(void* a, const void* b) {
     *(TYPE *)a = res_b / 2;
 }
 
+// Context of the _ctx tests: an offset to add, and the # jobs run by all the workers
+typedef struct Offset_Context {
+    TYPE offset;
+    size_t jobs;
+} Offset_Context;
+
+static void initCounter(void* state, void* ctx) {
+    *(size_t *)state = 0;
+}
+
+static void finiCounter(void* state, void* ctx) {
+    ((Offset_Context *)ctx)->jobs += *(size_t *)state;
+}
+
+static void workerAddOffset(void* a, const void* b, void* ctx, void* state) {
+    TYPE res_b = b == NULL ? SUM_NEUTRAL : *(TYPE *)b;
+
+    // a = b + offset
+    *(TYPE *)a = res_b + ((Offset_Context *)ctx)->offset;
+    (*(size_t *)state)++;
+}
+
+
+// Typed patterns over TYPE with +
+DEFINE_PATTERNS(double, add)
+
 
 //=======================================================
 // Unit testing funtions
@@ -111,6 +163,27 @@ void testScan (void *src, size_t n, size_t size) {
     free (dest);
 }
 
+void testMapTyped (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    map_double_add (dest, src, n, 1);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+void testReduceTyped (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (size);
+    reduce_double_add (dest, src, n);
+    printDouble (dest, 1, __FUNCTION__);
+    free (dest);
+}
+
+void testScanTyped (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    scan_double_add (dest, src, n);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
 void testPack (void *src, size_t n, size_t size) {
     int nFilter = 3;
     TYPE *dest = malloc (nFilter * size);
@@ -140,6 +213,38 @@ void testSplit (void *src, size_t n, size_t size) {
 
 }
 
+void testPackTyped (void *src, size_t n, size_t size) {
+    int nFilter = 3;
+    TYPE *dest = malloc (nFilter * size);
+    int *filter = calloc(n,sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = (i == 0 || i == n/2 || i == n-1);
+    int newN = pack_double (dest, src, n, filter);
+    printDouble (dest, newN, __FUNCTION__);
+    free(filter);
+    free (dest);
+}
+
+void testSplitArena (void *src, size_t n, size_t size) {
+    // Room in every slice for the bit sums and the scan trees of split
+    Scratch_Arena *arena = arena_create (par_total_workers () * 32 * n * sizeof(int), 0);
+    arena_set_current (arena);
+
+    TYPE *dest = malloc (n * size);
+    int *filter = calloc(n,sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = (i == 0 || i == n/2 || i == n-1);
+    int newN = split (dest, src, n, size, filter);
+    printDouble (dest, newN, __FUNCTION__);
+    if (debug)
+        printf ("%s: high water %lu bytes, %lu overflows\n", __FUNCTION__, arena_high_water (arena), arena_overflows (arena));
+
+    arena_set_current (NULL);
+    arena_destroy (arena);
+    free(filter);
+    free (dest);
+}
+
 void testGather (void *src, size_t n, size_t size) {
 	int nFilter = 3;
     TYPE *dest = malloc (nFilter * size);
@@ -179,6 +284,115 @@ void testPipeline (void *src, size_t n, size_t size) {
     free (dest);
 }
 
+void testPipelineAsync (void *src, size_t n, size_t size) {
+    void (*pipelineFunction[])(void*, const void*) = {
+        workerMultTwo,
+        workerAddOne,
+        workerDivTwo
+    };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    TYPE *dest = malloc (n * size);
+    pipeline_async (dest, src, n, size, pipelineFunction, nPipelineFunction);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+void testPipelineTyped (void *src, size_t n, size_t size) {
+    void (*pipelineFunction[])(void*, const void*) = {
+        workerToPair,
+        workerPairSum
+    };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    size_t sizeJob[] = { size, sizeof(Pair), size };
+    TYPE *dest = malloc (n * size);
+    pipeline_typed (dest, src, n, sizeJob, pipelineFunction, nPipelineFunction);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+void testPipelineFarmStages (void *src, size_t n, size_t size) {
+    void (*pipelineFunction[])(void*, const void*) = {
+        workerMultTwo,
+        workerAddOne,
+        workerDivTwo
+    };
+    size_t nFarms[] = { 1, 3, 2 };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    TYPE *dest = malloc (n * size);
+    pipeline_farm_stages (dest, src, n, size, pipelineFunction, nPipelineFunction, nFarms);
+    printDouble (dest, n, __FUNCTION__);
+    pipeline_farm_stages (dest, src, n, size, pipelineFunction, nPipelineFunction, NULL);
+    printDouble (dest, n, "testPipelineFarmStages (balanced)");
+    free (dest);
+}
+
+typedef struct Stream_Cursor {
+    TYPE *src;
+    TYPE *dest;
+    size_t n;
+    size_t produced;
+    size_t consumed;
+} Stream_Cursor;
+
+static int streamProducer(void *item, void *arg) {
+    Stream_Cursor *cursor = arg;
+    if (cursor->produced == cursor->n)
+        return 0;
+    *(TYPE *)item = cursor->src[cursor->produced++];
+    return 1;
+}
+
+static void streamConsumer(const void *item, void *arg) {
+    Stream_Cursor *cursor = arg;
+    cursor->dest[cursor->consumed++] = *(TYPE *)item;
+}
+
+void testPipelineStream (void *src, size_t n, size_t size) {
+    void (*pipelineFunction[])(void*, const void*) = {
+        workerMultTwo,
+        workerAddOne,
+        workerDivTwo
+    };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    TYPE *dest = malloc (n * size);
+    Stream_Cursor cursor = { src, dest, n, 0, 0 };
+    pipeline_stream (streamProducer, streamConsumer, &cursor, size, pipelineFunction, nPipelineFunction, 4);
+    printDouble (dest, cursor.consumed, __FUNCTION__);
+    free (dest);
+}
+
+// # times testPipelineStreamLong streams the source
+#define STREAM_REPEATS 64
+
+void testPipelineStreamLong (void *src, size_t n, size_t size) {
+    // Many more items than slots in the window, compared with the sequential stream
+    void (*pipelineFunction[])(void*, const void*) = {
+        workerMultTwo,
+        workerAddOne,
+        workerDivTwo
+    };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    size_t nItems = n * STREAM_REPEATS;
+    TYPE *items = malloc (nItems * size);
+    for (size_t i = 0;  i < nItems;  i++)
+        items[i] = ((TYPE *)src)[i % n];
+    TYPE *dest = malloc (nItems * size);
+    TYPE *expected = malloc (nItems * size);
+    Stream_Cursor cursor = { items, dest, nItems, 0, 0 };
+    Stream_Cursor expectedCursor = { items, expected, nItems, 0, 0 };
+    pipeline_stream (streamProducer, streamConsumer, &cursor, size, pipelineFunction, nPipelineFunction, 2);
+    pipeline_stream_seq (streamProducer, streamConsumer, &expectedCursor, size, pipelineFunction, nPipelineFunction, 2);
+    size_t differ = cursor.consumed == nItems ? 0 : nItems;
+    for (size_t i = 0;  i < cursor.consumed && i < nItems;  i++)
+        differ += dest[i] != expected[i];
+    if (differ > 0)
+        printf ("%s: %lu of %lu items differ\n", __FUNCTION__, differ, nItems);
+    printDouble (dest, n, __FUNCTION__);
+    free (expected);
+    free (dest);
+    free (items);
+}
+
 void testFarm (void *src, size_t n, size_t size) {
     TYPE *dest = malloc (n * size);
     farm (dest, src, n, size, workerAddOne, 3);
@@ -186,6 +400,271 @@ void testFarm (void *src, size_t n, size_t size) {
     free (dest);
 }
 
+void testFarmDynamic (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    farm_dynamic (dest, src, n, size, workerAddOne, 3, 1);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+void testPersistentFarm (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    Persistent_Farm *farm = farm_create (workerAddOne, size, 3);
+    // The first job on its own, the rest as a batch
+    Farm_Future *first = farm_submit (farm, dest, src, 1);
+    Farm_Future *rest = farm_submit (farm, dest + 1, (TYPE *)src + 1, n - 1);
+    farm_wait (first);
+    farm_wait (rest);
+    farm_destroy (farm);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+void testMapCtx (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    Offset_Context offset = { 1, 0 };
+    Worker_Context context = { &offset, sizeof(size_t), initCounter, finiCounter };
+    map_ctx (dest, src, n, size, workerAddOffset, &context);
+    printDouble (dest, n, __FUNCTION__);
+    if (debug)
+        printf ("%s: %lu jobs\n", __FUNCTION__, offset.jobs);
+    free (dest);
+}
+
+void testFarmCtx (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    Offset_Context offset = { 1, 0 };
+    Worker_Context context = { &offset, sizeof(size_t), initCounter, finiCounter };
+    farm_ctx (dest, src, n, size, workerAddOffset, 3, &context);
+    printDouble (dest, n, __FUNCTION__);
+    if (debug)
+        printf ("%s: %lu jobs\n", __FUNCTION__, offset.jobs);
+    free (dest);
+}
+
+void testPipelineCtx (void *src, size_t n, size_t size) {
+    void (*pipelineFunction[])(void*, const void*, void*, void*) = {
+        workerAddOffset,
+        workerAddOffset
+    };
+    int nPipelineFunction = sizeof (pipelineFunction)/sizeof(pipelineFunction[0]);
+    Offset_Context offset[] = { { 1, 0 }, { -2, 0 } };
+    Worker_Context context[] = {
+        { &offset[0], sizeof(size_t), initCounter, finiCounter },
+        { &offset[1], sizeof(size_t), initCounter, finiCounter }
+    };
+    TYPE *dest = malloc (n * size);
+    pipeline_ctx (dest, src, n, size, pipelineFunction, nPipelineFunction, context);
+    printDouble (dest, n, __FUNCTION__);
+    if (debug)
+        printf ("%s: %lu + %lu jobs\n", __FUNCTION__, offset[0].jobs, offset[1].jobs);
+    free (dest);
+}
+
+void testChainReduce (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (size);
+    int *filter = calloc(n,sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = i % 2 == 0;
+    Chain *chain = chain_create (src, n, size);
+    chain_map (chain, workerAddOne, size);
+    chain_pack (chain, filter);
+    size_t reduced = chain_reduce (chain, dest, workerAdd);
+    printDouble (dest, reduced > 0 ? 1 : 0, __FUNCTION__);
+    chain_destroy (chain);
+    // Nothing passes the filter, so nothing is reduced
+    memset (filter, 0, n * sizeof(*filter));
+    chain = chain_create (src, n, size);
+    chain_pack (chain, filter);
+    if (chain_reduce (chain, dest, workerAdd) != 0)
+        printf ("%s: reduced elements that were all filtered out\n", __FUNCTION__);
+    chain_destroy (chain);
+    free(filter);
+    free (dest);
+}
+
+void testChainScan (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    int *filter = malloc(n * sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = n - 1 - i;
+    Chain *chain = chain_gather (src, n, size, filter, n);
+    chain_map (chain, workerToPair, sizeof(Pair));
+    chain_map (chain, workerPairSum, size);
+    size_t newN = chain_scan (chain, dest, workerAdd);
+    printDouble (dest, newN, __FUNCTION__);
+    chain_destroy (chain);
+    free(filter);
+    free (dest);
+}
+
+void testAsync (void *src, size_t n, size_t size) {
+    // Two scans and a gather in flight at the same time
+    TYPE *scanned = malloc (n * size);
+    TYPE *doubled = malloc (n * size);
+    TYPE *copy = malloc (n * size);
+    TYPE *gathered = malloc (n * size);
+    int *filter = malloc(n * sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = n - 1 - i;
+    map (copy, src, n, size, workerMultTwo);
+    Async_Handle *first = async_scan (scanned, src, n, size, workerAdd);
+    Async_Handle *second = async_scan (doubled, copy, n, size, workerAdd);
+    Async_Handle *third = async_gather (gathered, src, n, size, filter, n);
+    async_wait (third);
+    async_wait (second);
+    async_wait (first);
+    printDouble (scanned, n, __FUNCTION__);
+    printDouble (doubled, n, __FUNCTION__);
+    printDouble (gathered, n, __FUNCTION__);
+    free(filter);
+    free (gathered);
+    free (copy);
+    free (doubled);
+    free (scanned);
+}
+
+// Writes the array to a new temporary file, whose path is left in path
+static void writeTempFile (char *path, const void *src, size_t bytes) {
+    strcpy (path, "/tmp/unitXXXXXX");
+    int fd = mkstemp (path);
+    if (fd < 0 || write (fd, src, bytes) != bytes)
+        perror (path);
+    close (fd);
+}
+
+static void readFile (const char *path, void *dest, size_t bytes) {
+    FILE *fp = fopen (path, "rb");
+    if (fp == NULL || fread (dest, 1, bytes, fp) != bytes)
+        perror (path);
+    if (fp != NULL)
+        fclose (fp);
+}
+
+void testReduceFile (void *src, size_t n, size_t size) {
+    char srcPath[32];
+    TYPE *dest = malloc (size);
+    writeTempFile (srcPath, src, n * size);
+    file_set_chunk_size (3 * size);
+    if (reduce_file (dest, srcPath, size, workerAdd) != 0)
+        perror (__FUNCTION__);
+    file_set_chunk_size (0);
+    printDouble (dest, 1, __FUNCTION__);
+    unlink (srcPath);
+    free (dest);
+}
+
+void testScanFile (void *src, size_t n, size_t size) {
+    char srcPath[32], destPath[32];
+    TYPE *dest = malloc (n * size);
+    writeTempFile (srcPath, src, n * size);
+    writeTempFile (destPath, NULL, 0);
+    // Small chunks, so that the carry goes through several of them
+    file_set_chunk_size (3 * size);
+    if (scan_file (destPath, srcPath, size, workerAdd) != 0)
+        perror (__FUNCTION__);
+    file_set_chunk_size (0);
+    readFile (destPath, dest, n * size);
+    printDouble (dest, n, __FUNCTION__);
+    unlink (destPath);
+    unlink (srcPath);
+    free (dest);
+}
+
+void testPackFile (void *src, size_t n, size_t size) {
+    char srcPath[32], destPath[32], filterPath[32];
+    TYPE *dest = malloc (n * size);
+    int *filter = calloc(n,sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = (i == 0 || i == n/2 || i == n-1);
+    writeTempFile (srcPath, src, n * size);
+    writeTempFile (filterPath, filter, n * sizeof(*filter));
+    writeTempFile (destPath, NULL, 0);
+    file_set_chunk_size (3 * size);
+    ssize_t newN = pack_file (destPath, srcPath, size, filterPath);
+    file_set_chunk_size (0);
+    if (newN < 0)
+        perror (__FUNCTION__);
+    readFile (destPath, dest, newN * size);
+    printDouble (dest, newN, __FUNCTION__);
+    unlink (filterPath);
+    unlink (destPath);
+    unlink (srcPath);
+    free(filter);
+    free (dest);
+}
+
+void testGatherFile (void *src, size_t n, size_t size) {
+    char srcPath[32], destPath[32], filterPath[32];
+    TYPE *dest = malloc (n * size);
+    int *filter = malloc(n * sizeof(*filter));
+    for (int i = 0;  i < n;  i++)
+        filter[i] = n - 1 - i;
+    writeTempFile (srcPath, src, n * size);
+    writeTempFile (filterPath, filter, n * sizeof(*filter));
+    writeTempFile (destPath, NULL, 0);
+    file_set_chunk_size (3 * size);
+    if (gather_file (destPath, srcPath, size, filterPath) != 0)
+        perror (__FUNCTION__);
+    file_set_chunk_size (0);
+    readFile (destPath, dest, n * size);
+    printDouble (dest, n, __FUNCTION__);
+    unlink (filterPath);
+    unlink (destPath);
+    unlink (srcPath);
+    free(filter);
+    free (dest);
+}
+
+void testReduceBatch (void *src, size_t n, size_t size) {
+    // Three problems over the thirds of the source
+    TYPE *dest = malloc (3 * size);
+    Pattern_Problem problems[3];
+    for (int i = 0;  i < 3;  i++)
+        problems[i] = (Pattern_Problem) { &dest[i], src + (i * n / 3) * size, (i + 1) * n / 3 - i * n / 3 };
+    reduce_batch (problems, 3, size, workerAdd);
+    printDouble (dest, 3, __FUNCTION__);
+    free (dest);
+}
+
+void testScanBatch (void *src, size_t n, size_t size) {
+    TYPE *dest = malloc (n * size);
+    Pattern_Problem problems[3];
+    for (int i = 0;  i < 3;  i++)
+        problems[i] = (Pattern_Problem) { &dest[i * n / 3], src + (i * n / 3) * size, (i + 1) * n / 3 - i * n / 3 };
+    scan_batch (problems, 3, size, workerAdd);
+    printDouble (dest, n, __FUNCTION__);
+    free (dest);
+}
+
+// 1 if the sums are equal but for the rounding of adding in another order
+static int closeTo (TYPE a, TYPE b) {
+    TYPE difference = a > b ? a - b : b - a;
+    TYPE magnitude = b < 0 ? -b : b;
+    return difference <= 1e-9 * magnitude;
+}
+
+void testScanVariants (void *src, size_t n, size_t size) {
+    // scan runs the selected tree, each one must give the sums of scan_seq
+    TYPE *dest = malloc (n * size);
+    TYPE *expected = malloc (n * size);
+    scan_seq (expected, src, n, size, workerAdd);
+    const char *selected = variant_selected (VARIANT_SCAN);
+    for (size_t i = 0;  i < variant_count (VARIANT_SCAN);  i++) {
+        variant_select (VARIANT_SCAN, variant_name (VARIANT_SCAN, i));
+        scan (dest, src, n, size, workerAdd);
+        printDouble (dest, n, variant_name (VARIANT_SCAN, i));
+        size_t differ = 0;
+        for (size_t k = 0;  k < n;  k++)
+            differ += !closeTo (dest[k], expected[k]);
+        if (differ > 0)
+            printf ("%s: %s differs from scan_seq in %lu of %lu sums\n", __FUNCTION__, variant_name (VARIANT_SCAN, i), differ, n);
+    }
+    variant_select (VARIANT_SCAN, selected);
+    free (expected);
+    free (dest);
+}
+
 
 //=======================================================
 // List of unit test functions
@@ -198,24 +677,74 @@ TESTFUNCTION testFunction[] = {
     testMap,
     testReduce,
     testScan,
+    testMapTyped,
+    testReduceTyped,
+    testScanTyped,
     testPack,
+    testPackTyped,
 	testSplit,
+    testSplitArena,
     testGather,
     testScatter,
     testPipeline,
+    testPipelineAsync,
+    testPipelineTyped,
+    testPipelineFarmStages,
+    testPipelineStream,
+    testPipelineStreamLong,
     testFarm,
+    testFarmDynamic,
+    testPersistentFarm,
+    testMapCtx,
+    testFarmCtx,
+    testPipelineCtx,
+    testChainReduce,
+    testChainScan,
+    testAsync,
+    testReduceFile,
+    testScanFile,
+    testPackFile,
+    testGatherFile,
+    testReduceBatch,
+    testScanBatch,
+    testScanVariants,
 };
 
 char *testNames[] = {
     "testMap",
     "testReduce",
     "testScan",
+    "testMapTyped",
+    "testReduceTyped",
+    "testScanTyped",
     "testPack",
+    "testPackTyped",
 	"testSplit",
+    "testSplitArena",
     "testGather",
     "testScatter",
     "testPipeline",
+    "testPipelineAsync",
+    "testPipelineTyped",
+    "testPipelineFarmStages",
+    "testPipelineStream",
+    "testPipelineStreamLong",
     "testFarm",
+    "testFarmDynamic",
+    "testPersistentFarm",
+    "testMapCtx",
+    "testFarmCtx",
+    "testPipelineCtx",
+    "testChainReduce",
+    "testChainScan",
+    "testAsync",
+    "testReduceFile",
+    "testScanFile",
+    "testPackFile",
+    "testGatherFile",
+    "testReduceBatch",
+    "testScanBatch",
+    "testScanVariants",
 };
 
 int nTestFunction = sizeof (testFunction)/sizeof(testFunction[0]);
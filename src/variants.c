@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "patterns.h"
+#include "prefix_scan.h"
+#include "parallel.h"
+#include "variants.h"
+
+/*
+ * Implementation of the variant registry.
+ * The variants of each pattern are kept in a fixed array, in the order they were registered, and
+ * the selection is the index of one of them. Registering takes a lock; running the selected
+ * variant only reads the index, since variants are never removed.
+ */
+
+// # elements of each tile of the tiled_reduce variant
+#define VARIANT_TILE_SIZE 16
+
+// Environment variable with the initial selection
+#define VARIANTS_ENV "PATTERN_VARIANTS"
+
+typedef struct Variant {
+	const char *name;
+	Variant_Function function;
+} Variant;
+
+static const char *pattern_names[VARIANT_PATTERNS] = { "reduce", "scan", "pipeline" };
+
+static Variant variants[VARIANT_PATTERNS][VARIANTS_MAX];
+static size_t n_variants[VARIANT_PATTERNS];
+static size_t selected[VARIANT_PATTERNS];
+
+static pthread_once_t builtins_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t variants_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void tiledReduce(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	tiled_reduce(dest, src, nJob, sizeJob, worker, VARIANT_TILE_SIZE);
+}
+
+static void scanStatic(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	prefix_scan_static(src, dest, nJob, sizeJob, worker);
+}
+
+static void scanDynamic(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	prefix_scan_dynamic(src, dest, nJob, sizeJob, worker);
+}
+
+static void pipelineFarm(void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	pipeline_farm(dest, src, nJob, sizeJob, workerList, nWorkers, par_nworkers());
+}
+
+static int findVariant(Variant_Pattern pattern, const char *name) {
+	for (size_t i = 0; i < n_variants[pattern]; i++)
+		if (strcmp(variants[pattern][i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+static int addVariant(Variant_Pattern pattern, const char *name, Variant_Function function) {
+	pthread_mutex_lock(&variants_lock);
+	int added = findVariant(pattern, name) < 0 && n_variants[pattern] < VARIANTS_MAX;
+	if (added) {
+		variants[pattern][n_variants[pattern]] = (Variant) { name, function };
+		__atomic_store_n(&n_variants[pattern], n_variants[pattern] + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&variants_lock);
+
+	return added ? 0 : -1;
+}
+
+static int selectVariant(Variant_Pattern pattern, const char *name) {
+	int i = findVariant(pattern, name);
+	if (i < 0)
+		return -1;
+
+	__atomic_store_n(&selected[pattern], i, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int selectList(const char *list) {
+	int status = 0;
+
+	while (*list != '\0') {
+		size_t length = strcspn(list, ",");
+		char entry[length + 1];
+		memcpy(entry, list, length);
+		entry[length] = '\0';
+		list += list[length] == ',' ? length + 1 : length;
+
+		char *name = strchr(entry, '=');
+		if (name == NULL) {
+			status = -1;
+			continue;
+		}
+		*name++ = '\0';
+
+		Variant_Pattern pattern = 0;
+		while (pattern < VARIANT_PATTERNS && strcmp(pattern_names[pattern], entry) != 0)
+			pattern++;
+		if (pattern == VARIANT_PATTERNS || selectVariant(pattern, name) != 0)
+			status = -1;
+	}
+
+	return status;
+}
+
+static void registerBuiltins(void) {
+	addVariant(VARIANT_REDUCE, "reduce", (Variant_Function) { .reduce = reduce });
+	addVariant(VARIANT_REDUCE, "tiled_reduce", (Variant_Function) { .reduce = tiledReduce });
+
+	addVariant(VARIANT_SCAN, "scan_static", (Variant_Function) { .scan = scanStatic });
+	addVariant(VARIANT_SCAN, "scan_dynamic", (Variant_Function) { .scan = scanDynamic });
+
+	addVariant(VARIANT_PIPELINE, "pipeline", (Variant_Function) { .pipeline = pipeline });
+	addVariant(VARIANT_PIPELINE, "pipeline_farm", (Variant_Function) { .pipeline = pipelineFarm });
+	addVariant(VARIANT_PIPELINE, "pipeline_async", (Variant_Function) { .pipeline = pipeline_async });
+
+	const char *list = getenv(VARIANTS_ENV);
+	if (list != NULL && selectList(list) != 0)
+		fprintf(stderr, "%s: some variants of \"%s\" do not exist\n", VARIANTS_ENV, list);
+}
+
+static void initVariants(void) {
+	pthread_once(&builtins_once, registerBuiltins);
+}
+
+const char *variant_pattern_name (Variant_Pattern pattern) {
+	assert (pattern < VARIANT_PATTERNS);
+
+	return pattern_names[pattern];
+}
+
+int variant_register (Variant_Pattern pattern, const char *name, Variant_Function function) {
+	assert (pattern < VARIANT_PATTERNS);
+	assert (name != NULL);
+
+	initVariants();
+	return addVariant(pattern, name, function);
+}
+
+size_t variant_count (Variant_Pattern pattern) {
+	assert (pattern < VARIANT_PATTERNS);
+
+	initVariants();
+	return __atomic_load_n(&n_variants[pattern], __ATOMIC_ACQUIRE);
+}
+
+const char *variant_name (Variant_Pattern pattern, size_t i) {
+	assert (i < variant_count(pattern));
+
+	return variants[pattern][i].name;
+}
+
+Variant_Function variant_get (Variant_Pattern pattern, size_t i) {
+	assert (i < variant_count(pattern));
+
+	return variants[pattern][i].function;
+}
+
+int variant_find (Variant_Pattern pattern, const char *name) {
+	assert (pattern < VARIANT_PATTERNS);
+	assert (name != NULL);
+
+	initVariants();
+	return findVariant(pattern, name);
+}
+
+int variant_select (Variant_Pattern pattern, const char *name) {
+	assert (pattern < VARIANT_PATTERNS);
+	assert (name != NULL);
+
+	initVariants();
+	return selectVariant(pattern, name);
+}
+
+int variant_select_list (const char *list) {
+	assert (list != NULL);
+
+	initVariants();
+	return selectList(list);
+}
+
+const char *variant_selected (Variant_Pattern pattern) {
+	assert (pattern < VARIANT_PATTERNS);
+
+	initVariants();
+	return variants[pattern][__atomic_load_n(&selected[pattern], __ATOMIC_ACQUIRE)].name;
+}
+
+static Variant_Function selectedFunction(Variant_Pattern pattern) {
+	initVariants();
+	return variants[pattern][__atomic_load_n(&selected[pattern], __ATOMIC_ACQUIRE)].function;
+}
+
+void variant_reduce (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	selectedFunction(VARIANT_REDUCE).reduce(dest, src, nJob, sizeJob, worker);
+}
+
+void variant_scan (void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3)) {
+	selectedFunction(VARIANT_SCAN).scan(dest, src, nJob, sizeJob, worker);
+}
+
+void variant_pipeline (void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers) {
+	selectedFunction(VARIANT_PIPELINE).pipeline(dest, src, nJob, sizeJob, workerList, nWorkers);
+}
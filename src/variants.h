@@ -0,0 +1,129 @@
+#ifndef __VARIANTS_H
+#define __VARIANTS_H
+
+#include <stddef.h>
+
+/*
+ * Registry of the implementations (variants) of the patterns that have more than one, so that
+ * they can be listed, benchmarked and chosen at run time instead of at link time:
+ *
+ *   variant_select (VARIANT_SCAN, "scan_dynamic");
+ *   scan (dest, src, nJob, sizeof(double), workerAdd);      // runs the dynamic tree
+ *   variant_reduce (dest, src, nJob, sizeof(double), workerAdd);  // runs the selected reduce
+ *
+ * The variants of each pattern take the arguments of the pattern; those that need more, like the
+ * tile size of tiled_reduce, are registered with a fixed value for them. The built-in variants:
+ *
+ *   reduce      reduce, tiled_reduce
+ *   scan        scan_static, scan_dynamic (the prefix scan trees of scan)
+ *   pipeline    pipeline, pipeline_farm (one pipeline per worker), pipeline_async
+ *
+ * The first variant of each pattern is selected until another one is. The selection can also be
+ * given in the environment variable PATTERN_VARIANTS, as a list like "scan=scan_dynamic,reduce=
+ * tiled_reduce", which is read when the registry is first used.
+ */
+
+typedef enum Variant_Pattern {
+	VARIANT_REDUCE,
+	VARIANT_SCAN,
+	VARIANT_PIPELINE,
+	VARIANT_PATTERNS
+} Variant_Pattern;
+
+// Most variants of each pattern
+#define VARIANTS_MAX 16
+
+typedef void (*Reduce_Variant)(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3));
+
+typedef void (*Scan_Variant)(void *dest, void *src, size_t nJob, size_t sizeJob, void (*worker)(void *v1, const void *v2, const void *v3));
+
+typedef void (*Pipeline_Variant)(void *dest, void *src, size_t nJob, size_t sizeJob, void (*workerList[])(void *v1, const void *v2), size_t nWorkers);
+
+// Implementation of a variant, of the type of its pattern
+typedef union Variant_Function {
+	Reduce_Variant reduce;
+	Scan_Variant scan;
+	Pipeline_Variant pipeline;
+} Variant_Function;
+
+/*
+ * Name of a pattern ("reduce", "scan", "pipeline").
+ */
+const char *variant_pattern_name (Variant_Pattern pattern);
+
+/*
+ * Adds a variant to a pattern. Returns -1 if the pattern has a variant of that name already, or
+ * VARIANTS_MAX of them.
+ */
+int variant_register (
+  Variant_Pattern pattern, // Pattern the variant implements
+  const char *name,     // Name of the variant, kept by the registry
+  Variant_Function function // Implementation
+);
+
+/*
+ * # variants of a pattern.
+ */
+size_t variant_count (Variant_Pattern pattern);
+
+/*
+ * Name of the i-th variant of a pattern, in the order they were registered.
+ */
+const char *variant_name (Variant_Pattern pattern, size_t i);
+
+/*
+ * Implementation of the i-th variant of a pattern.
+ */
+Variant_Function variant_get (Variant_Pattern pattern, size_t i);
+
+/*
+ * Index of the variant of a pattern with that name, or -1.
+ */
+int variant_find (Variant_Pattern pattern, const char *name);
+
+/*
+ * Selects the variant of a pattern with that name. Returns -1, and keeps the selection, if the
+ * pattern has no such variant.
+ */
+int variant_select (Variant_Pattern pattern, const char *name);
+
+/*
+ * Selects variants from a list like "scan=scan_dynamic,reduce=tiled_reduce". Returns -1 if some
+ * entry names no variant; the others are selected anyway.
+ */
+int variant_select_list (const char *list);
+
+/*
+ * Name of the selected variant of a pattern.
+ */
+const char *variant_selected (Variant_Pattern pattern);
+
+/*
+ * Run the selected variant of their pattern.
+ */
+void variant_reduce (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+void variant_scan (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*worker)(void *v1, const void *v2, const void *v3) // [ v1 = op (v2, v3) ]
+);
+
+void variant_pipeline (
+  void *dest,           // Target array
+  void *src,            // Source array
+  size_t nJob,          // # elements in the source array
+  size_t sizeJob,       // Size of each element in the source array
+  void (*workerList[])(void *v1, const void *v2), // one function for each stage of the pipeline
+  size_t nWorkers       // # stages in the pipeline
+);
+
+#endif